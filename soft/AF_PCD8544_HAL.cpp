@@ -17,22 +17,93 @@ Augmented to work with STM32 HAL by Denis Kokarev
 *********************************************************************/
 
 #include <cstdlib>
+#include <atomic>
 
 #include "AF_PCD8544_HAL.h"
 #include "stm32f3xx_hal.h"
+#include "cycles.h"
+#include "unpack.h"
+
+/*
+ * the classic Adafruit font is private to Adafruit_GFX.cpp, so we take
+ * our own copy the same way Adafruit_GFX.cpp does. Its 5 bytes per glyph
+ * are already LSB-on-top columns, i.e. exactly the PCD8544 bank layout
+ */
+#include "glcdfont.c"
+
+/// the classic font cell is 5 glyph columns plus 1 spacing column
+constexpr int16_t GLYPH_WIDTH = 6;
+/// the classic font cell height matches one PCD8544 bank
+constexpr int16_t GLYPH_HEIGHT = 8;
 
 #define	LOW		GPIO_PIN_RESET
 #define	HIGH	GPIO_PIN_SET
 
-enum {
-	COMMAND = 0,
-	DATA = 1
-};
+/// the screen currently transferring, to route HAL SPI callbacks to it
+static AF_PCD8544_HAL *active;
+
+#ifdef PCD8544_LL
+
+/*
+ * Register level backend: DC/CS go via BSRR/BRR and the SPI DMA transfers
+ * are started by writing SPI and DMA channel registers directly, skipping
+ * all HAL state machine checks. The DMA channel is still initialized by
+ * CubeMX code and the transfer completion still arrives through
+ * HAL_DMA_IRQHandler() into the handle's XferCpltCallback
+ */
+
+static void digitalWrite(const STM_HAL_Pin &pin, GPIO_PinState val) {
+	if (val == HIGH)
+		pin.base->BSRR = pin.pin;
+	else
+		pin.base->BRR = pin.pin;
+}
+
+/// DMA is done feeding SPI, wait for the last bytes to leave the shift register
+static void dmaComplete(DMA_HandleTypeDef *hdma) {
+	SPI_TypeDef *spi = active->spi().Instance;
+	while ((spi->SR & SPI_SR_FTLVL) != 0 || (spi->SR & SPI_SR_BSY) != 0) {
+	}
+	spi->CR2 &= ~SPI_CR2_TXDMAEN;
+	// nobody reads the received bytes, clear the overrun the way HAL does
+	uint32_t ovr = spi->DR;
+	ovr = spi->SR;
+	(void)ovr;
+	active->transferComplete();
+}
+
+static bool spiTransmitDMA(SPI_HandleTypeDef &hspi, uint8_t *p, uint16_t sz) {
+	SPI_TypeDef *spi = hspi.Instance;
+	DMA_HandleTypeDef *hdma = hspi.hdmatx;
+	DMA_Channel_TypeDef *ch = hdma->Instance;
+	ch->CCR &= ~DMA_CCR_EN;
+	ch->CPAR = reinterpret_cast<uintptr_t>(&spi->DR);
+	ch->CMAR = reinterpret_cast<uintptr_t>(p);
+	ch->CNDTR = sz;
+	hdma->XferCpltCallback = dmaComplete;
+	ch->CCR |= DMA_CCR_TCIE | DMA_CCR_EN;
+	spi->CR2 |= SPI_CR2_TXDMAEN;
+	spi->CR1 |= SPI_CR1_SPE;
+	return true;
+}
+
+#else
+
+/*
+ * HAL backend: everything goes via HAL GPIO and SPI drivers and
+ * the transfer completion arrives into HAL_SPI_TxCpltCallback()
+ */
 
 static void digitalWrite(const STM_HAL_Pin &pin, GPIO_PinState val) {
 	HAL_GPIO_WritePin(pin.base, pin.pin, val);
 }
 
+static bool spiTransmitDMA(SPI_HandleTypeDef &hspi, uint8_t *p, uint16_t sz) {
+	return HAL_SPI_Transmit_DMA(&hspi, p, sz) == HAL_OK;
+}
+
+#endif
+
 #ifndef _BV
   #define _BV(bit) (1<<(bit))
 #endif
@@ -42,12 +113,38 @@ AF_PCD8544_HAL::AF_PCD8544_HAL(SPI_HandleTypeDef &hspi,
 										   const STM_HAL_Pin &cs,
 										   const STM_HAL_Pin &rst
 										   ):
-	Adafruit_GFX(LCDWIDTH, LCDHEIGHT),
+	Adafruit_GFX(PCD8544_VWIDTH, PCD8544_VHEIGHT),
 	_hspi(hspi),
 	_dc(dc),
 	_cs(cs),
-	_rst(rst)
+	_rst(rst),
+	mode(IDLE),
+	cmdlen(0),
+	queueTaken(false),
+	row(nullptr),
+	rowSz(0),
+	rowStride(0),
+	rows(0),
+	rowShift(0),
+	rowX(-1),
+	rowBank(0),
+	rowAddrDue(false),
+	stats(),
+	frameHook(nullptr),
+	busySince(0),
+	viewX(0),
+	viewY(0),
+	background(nullptr),
+	layerOp(LAYER_OR),
+	effect(EFFECT_NORMAL)
+#if PCD8544_GRAY_PLANES
+	,grayPeriod(0),
+	grayCount(0),
+	grayPlane(0),
+	grayStats()
+#endif
 {
+	clearDirty();
 }
 
 
@@ -61,50 +158,169 @@ void AF_PCD8544_HAL::drawPixel(int16_t x, int16_t y, uint16_t color) {
     case 1:
       t = x;
       x = y;
-      y =  LCDHEIGHT - 1 - t;
+      y =  PCD8544_VHEIGHT - 1 - t;
       break;
     case 2:
-      x = LCDWIDTH - 1 - x;
-      y = LCDHEIGHT - 1 - y;
+      x = PCD8544_VWIDTH - 1 - x;
+      y = PCD8544_VHEIGHT - 1 - y;
       break;
     case 3:
       t = x;
-      x = LCDWIDTH - 1 - y;
+      x = PCD8544_VWIDTH - 1 - y;
       y = t;
       break;
   }
 
-  if ((x < 0) || (x >= LCDWIDTH) || (y < 0) || (y >= LCDHEIGHT))
+  if ((x < 0) || (x >= PCD8544_VWIDTH) || (y < 0) || (y >= PCD8544_VHEIGHT))
     return;
 
   // x is which column
   if (color) 
-    pcd8544_buffer[x+ (y/8)*LCDWIDTH] |= _BV(y%8);  
+    pcd8544_buffer[x+ (y/8)*PCD8544_VWIDTH] |= _BV(y%8);  
   else
-    pcd8544_buffer[x+ (y/8)*LCDWIDTH] &= ~_BV(y%8); 
+    pcd8544_buffer[x+ (y/8)*PCD8544_VWIDTH] &= ~_BV(y%8); 
 
 }
 
 
+void AF_PCD8544_HAL::fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+  if (rotation != 0) {
+    Adafruit_GFX::fillRect(x, y, w, h, color);
+    return;
+  }
+  if (x < 0) {
+    w += x;
+    x = 0;
+  }
+  if (y < 0) {
+    h += y;
+    y = 0;
+  }
+  if (x + w > PCD8544_VWIDTH)
+    w = PCD8544_VWIDTH - x;
+  if (y + h > PCD8544_VHEIGHT)
+    h = PCD8544_VHEIGHT - y;
+  if (w <= 0 || h <= 0)
+    return;
+
+  for (int16_t b=y/8; b<=(y+h-1)/8; b++) {
+    uint8_t top = (b == y/8) ? y%8 : 0;
+    uint8_t bottom = (b == (y+h-1)/8) ? (y+h-1)%8 : 7;
+    uint8_t mask = (0xff << top) & (0xff >> (7 - bottom));
+    uint8_t *p = &pcd8544_buffer[x + b*PCD8544_VWIDTH];
+    if (mask == 0xff) {
+      memset(p, color ? 0xff : 0, w);
+    } else if (color) {
+      for (int16_t i=0; i<w; i++)
+        p[i] |= mask;
+    } else {
+      for (int16_t i=0; i<w; i++)
+        p[i] &= ~mask;
+    }
+  }
+}
+
+
+// the classic font character at arbitrary x,y without going through drawPixel()
+void AF_PCD8544_HAL::drawGlyph(int16_t x, int16_t y, uint8_t c) {
+  if ((x < 0) || (x + GLYPH_WIDTH > PCD8544_VWIDTH) || (y < 0) || (y + GLYPH_HEIGHT > PCD8544_VHEIGHT)) {
+    drawChar(x, y, c, textcolor, textbgcolor, 1);
+    return;
+  }
+
+  if (!_cp437 && (c >= 176))
+    c++; // same quirk as Adafruit_GFX::drawChar()
+
+  // when both colors are the same the background stays transparent
+  bool opaque = (textcolor != textbgcolor);
+  uint8_t *p = &pcd8544_buffer[x + (y/8)*PCD8544_VWIDTH];
+  uint8_t shift = y%8;
+
+  for (int16_t i=0; i<GLYPH_WIDTH; i++) {
+    uint8_t line = (i < GLYPH_WIDTH-1) ? pgm_read_byte(&font[c*5 + i]) : 0;
+    uint8_t mask = opaque ? 0xff : line;
+    uint8_t bits = (textcolor ? line : 0) | ((opaque && textbgcolor) ? ~line : 0);
+    if (shift == 0) {
+      p[i] = (p[i] & ~mask) | (bits & mask);
+    } else {
+      // the cell straddles two banks
+      uint16_t m = mask << shift;
+      uint16_t b = (bits & mask) << shift;
+      p[i] = (p[i] & ~m) | b;
+      p[i+PCD8544_VWIDTH] = (p[i+PCD8544_VWIDTH] & ~(m>>8)) | (b>>8);
+    }
+  }
+}
+
+void AF_PCD8544_HAL::drawBank(int16_t x, uint8_t bank, const uint8_t *cols, uint8_t w) {
+  if (bank >= PCD8544_VHEIGHT/8)
+    return;
+  if (x < 0) {
+    if (-x >= w)
+      return;
+    cols -= x;
+    w += x;
+    x = 0;
+  }
+  if (x + w > PCD8544_VWIDTH) {
+    if (x >= PCD8544_VWIDTH)
+      return;
+    w = PCD8544_VWIDTH - x;
+  }
+  memcpy(&pcd8544_buffer[x + bank*PCD8544_VWIDTH], cols, w);
+}
+
+bool AF_PCD8544_HAL::drawPacked(int16_t x, uint8_t bank, const uint8_t *packed) {
+  if ((x < 0) || (x + packedWidth(packed) > PCD8544_VWIDTH) || (bank + packedBanks(packed) > PCD8544_VHEIGHT/8))
+    return false;
+  unpack(packed, &pcd8544_buffer[x + bank*PCD8544_VWIDTH], PCD8544_VWIDTH);
+  return true;
+}
+
+void AF_PCD8544_HAL::write(uint8_t c) {
+  write(&c, 1);
+}
+
+void AF_PCD8544_HAL::write(const uint8_t *buf, size_t sz) {
+  if (textsize != 1 || rotation != 0 || gfxFont) {
+    while (sz--)
+      Adafruit_GFX::write(*buf++);
+    return;
+  }
+  // same cursor movement as Adafruit_GFX::write()
+  for (; sz > 0; sz--) {
+    uint8_t c = *buf++;
+    if (c == '\n') {
+      cursor_x = 0;
+      cursor_y += GLYPH_HEIGHT;
+    } else if (c != '\r') {
+      if (wrap && (cursor_x + GLYPH_WIDTH > _width)) {
+        cursor_x = 0;
+        cursor_y += GLYPH_HEIGHT;
+      }
+      drawGlyph(cursor_x, cursor_y, c);
+      cursor_x += GLYPH_WIDTH;
+    }
+  }
+}
+
+
 // the most basic function, get a single pixel
-uint8_t AF_PCD8544_HAL::getPixel(int8_t x, int8_t y) {
-  if ((x < 0) || (x >= LCDWIDTH) || (y < 0) || (y >= LCDHEIGHT))
+uint8_t AF_PCD8544_HAL::getPixel(int16_t x, int16_t y) {
+  if ((x < 0) || (x >= PCD8544_VWIDTH) || (y < 0) || (y >= PCD8544_VHEIGHT))
     return 0;
 
-  return (pcd8544_buffer[x+ (y/8)*LCDWIDTH] >> (y%8)) & 0x1;  
+  return (pcd8544_buffer[x+ (y/8)*PCD8544_VWIDTH] >> (y%8)) & 0x1;  
 }
 
 
 void AF_PCD8544_HAL::begin(uint8_t contrast, uint8_t bias) {
+  digitalWrite(_cs, HIGH);
   digitalWrite(_rst, LOW);
   HAL_Delay(250);
   digitalWrite(_rst, HIGH);
   HAL_Delay(250);
 
-  digitalWrite(_cs, LOW);
-  digitalWrite(_dc, LOW);
-  mode = COMMAND;
-  
   // get into the EXTENDED mode!
   command(PCD8544_FUNCTIONSET | PCD8544_EXTENDEDINSTRUCTION );
 
@@ -123,31 +339,140 @@ void AF_PCD8544_HAL::begin(uint8_t contrast, uint8_t bias) {
 
   // Set display to Normal
   command(PCD8544_DISPLAYCONTROL | PCD8544_DISPLAYNORMAL);
-  digitalWrite(_cs, HIGH);
+  effect = EFFECT_NORMAL;
+  flush();
+  sync();
 }
 
 
-void AF_PCD8544_HAL::data(uint8_t *p, uint16_t sz) {
-    // Hardware SPI write.
-	if (mode != DATA) {
-		while(HAL_SPI_GetState(&_hspi) != HAL_SPI_STATE_READY) {
-		}
-		digitalWrite(_dc, HIGH);
-		mode = DATA;
+void AF_PCD8544_HAL::sync() {
+	while (mode != IDLE) {
 	}
-	HAL_SPI_Transmit_DMA(&_hspi, p, sz);
-	while(HAL_SPI_GetState(&_hspi) != HAL_SPI_STATE_READY) {
+}
+
+void AF_PCD8544_HAL::transmit(uint8_t m, uint8_t *p, uint16_t sz) {
+	digitalWrite(_dc, (m == DATA) ? HIGH : LOW);
+	mode = m;
+	stats.transfers++;
+	stats.bytes += sz;
+	if (!spiTransmitDMA(_hspi, p, sz)) {
+		transferError();
 	}
 }
 
-void AF_PCD8544_HAL::command(uint8_t c) {
-	if (mode != COMMAND) {
-		while(HAL_SPI_GetState(&_hspi) != HAL_SPI_STATE_READY) {
-		}
-		digitalWrite(_dc, LOW);
-		mode = COMMAND;
+uint8_t *AF_PCD8544_HAL::nextRow() {
+	uint8_t *p = row;
+	row += rowStride;
+#if PCD8544_VHEIGHT > LCDHEIGHT
+	if (rowShift) {
+		// the viewport is between the banks, merge two of them
+		for (uint16_t i=0; i<rowSz; i++)
+			line[i] = (p[i] >> rowShift) | (p[i+rowStride] << (8-rowShift));
+		return line;
 	}
-	HAL_SPI_Transmit(&_hspi, &c, 1, 0);
+#endif
+	return p;
+}
+
+void AF_PCD8544_HAL::transferComplete() {
+	if (rows > 0 && rowAddrDue) {
+		// the row goes to its own place on the screen
+		rowAddrDue = false;
+		rowCmd[0] = PCD8544_SETYADDR | rowBank++;
+		rowCmd[1] = PCD8544_SETXADDR | rowX;
+		transmit(COMMAND, rowCmd, sizeof(rowCmd));
+	} else if (rows > 0) {
+		rows--;
+		rowAddrDue = (rowX >= 0);
+		transmit(DATA, nextRow(), rowSz);
+	} else {
+		digitalWrite(_cs, HIGH);
+		stats.busyCycles += cycles() - busySince;
+		mode = IDLE;
+		if (frameHook)
+			frameHook(true);
+	}
+}
+
+void AF_PCD8544_HAL::frameStart() {
+	if (!frameHook)
+		return;
+	// so that the completion of the previous one isn't taken for this one
+	sync();
+	frameHook(false);
+}
+
+void AF_PCD8544_HAL::transferError() {
+	// drop the whole sequence, the next frame will fix the picture
+	rows = 0;
+	transferComplete();
+}
+
+/**
+ * @brief takes the command queue and the rows for the scope, grayTick() interrupt skips meanwhile
+ */
+class QueueGuard {
+	volatile bool &taken;	///< AF_PCD8544_HAL::queueTaken
+	bool was;				///< taken by the caller already
+public:
+	explicit QueueGuard(volatile bool &t):taken(t),was(t) {
+		taken = true;
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+	}
+	~QueueGuard() {
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+		taken = was;
+	}
+};
+
+void AF_PCD8544_HAL::select() {
+	active = this;
+	busySince = cycles();
+	digitalWrite(_cs, LOW);
+}
+
+void AF_PCD8544_HAL::flush() {
+	if (cmdlen == 0)
+		return;
+	QueueGuard guard(queueTaken);
+	sync();
+	select();
+	uint8_t n = cmdlen;
+	cmdlen = 0;
+	transmit(COMMAND, cmdbuf, n);
+}
+
+void AF_PCD8544_HAL::stream(uint8_t *p, uint16_t sz, uint16_t stride, uint8_t n, uint8_t shift, int16_t x, uint8_t bank) {
+	QueueGuard guard(queueTaken);
+	sync();
+	row = p;
+	rowSz = sz;
+	rowStride = stride;
+	rows = n;
+	rowShift = shift;
+	rowX = x;
+	rowBank = bank;
+	rowAddrDue = (x >= 0);
+	if (cmdlen > 0) {
+		// rows go from the commands completion interrupt
+		flush();
+	} else {
+		select();
+		transferComplete();
+	}
+}
+
+void AF_PCD8544_HAL::data(uint8_t *p, uint16_t sz) {
+	stream(p, sz, 0, 1, 0);
+}
+
+void AF_PCD8544_HAL::command(uint8_t c) {
+	QueueGuard guard(queueTaken);
+	if (cmdlen == sizeof(cmdbuf))
+		flush();
+	if (cmdlen == 0)
+		sync(); // cmdbuf may still be in flight, flushed just now included
+	cmdbuf[cmdlen++] = c;
 }
 
 void AF_PCD8544_HAL::setContrast(uint8_t val) {
@@ -157,24 +482,246 @@ void AF_PCD8544_HAL::setContrast(uint8_t val) {
   command(PCD8544_FUNCTIONSET | PCD8544_EXTENDEDINSTRUCTION );
   command( PCD8544_SETVOP | val); 
   command(PCD8544_FUNCTIONSET);
+  flush();
  }
 
 
 
+void AF_PCD8544_HAL::setEffect(Effect e) {
+	command(PCD8544_DISPLAYCONTROL | e);
+	flush();
+	effect = e;
+}
+
+void AF_PCD8544_HAL::setViewport(int16_t x, int16_t y) {
+	if (x > PCD8544_VWIDTH - LCDWIDTH)
+		x = PCD8544_VWIDTH - LCDWIDTH;
+	if (x < 0)
+		x = 0;
+	if (y > PCD8544_VHEIGHT - LCDHEIGHT)
+		y = PCD8544_VHEIGHT - LCDHEIGHT;
+	if (y < 0)
+		y = 0;
+	viewX = x;
+	viewY = y;
+}
+
 void AF_PCD8544_HAL::display(void) {
-  
-	digitalWrite(_cs, LOW);
-  
-    command(PCD8544_SETYADDR | 0);
-    command(PCD8544_SETXADDR | 0);
+#if PCD8544_GRAY_PLANES
+	if (grayActive())
+		return;
+#endif
+	uint32_t start = cycles();
+
+	command(PCD8544_SETYADDR | 0);
+	command(PCD8544_SETXADDR | 0);
+
+	uint8_t *p = &pcd8544_buffer[viewX + (viewY/8)*PCD8544_VWIDTH];
+	frameStart();
+	if (PCD8544_VWIDTH == LCDWIDTH && viewY%8 == 0) {
+		// the viewport is a contiguous piece of the buffer
+		stream(p, LCDWIDTH*LCDHEIGHT/8, 0, 1, 0);
+	} else {
+		// bank by bank
+		stream(p, LCDWIDTH, PCD8544_VWIDTH, LCDHEIGHT/8, viewY%8);
+	}
+
+	stats.frames++;
+	stats.setupCycles += cycles() - start;
+}
+
+void AF_PCD8544_HAL::displayRect(int16_t x, int16_t y, int16_t w, int16_t h) {
+#if PCD8544_GRAY_PLANES
+	if (grayActive())
+		return;
+#endif
+	uint32_t start = cycles();
+
+	// the screen part of it
+	x -= viewX;
+	y -= viewY;
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	if (x + w > LCDWIDTH)
+		w = LCDWIDTH - x;
+	if (y + h > LCDHEIGHT)
+		h = LCDHEIGHT - y;
+	if (w <= 0 || h <= 0)
+		return;
+
+	uint8_t first = y/8;
+	uint8_t last = (y+h-1)/8;
+	uint8_t *p = &pcd8544_buffer[viewX + x + (viewY/8 + first)*PCD8544_VWIDTH];
+	frameStart();
+	stream(p, w, PCD8544_VWIDTH, last-first+1, viewY%8, x, first);
+
+	stats.frames++;
+	stats.setupCycles += cycles() - start;
+}
+
+void AF_PCD8544_HAL::setBackground(const uint8_t *bg, LayerOp op) {
+	background = bg;
+	layerOp = op;
+}
+
+#if PCD8544_LAYER
+void AF_PCD8544_HAL::captureBackground(LayerOp op) {
+	memcpy(layer, pcd8544_buffer, sizeof(layer));
+	setBackground(layer, op);
+}
+#endif
+
+void AF_PCD8544_HAL::clearDirty() {
+	for (int b=0; b<PCD8544_VHEIGHT/8; b++) {
+		dirtyFrom[b] = PCD8544_VWIDTH;
+		dirtyTo[b] = 0;
+	}
+}
+
+void AF_PCD8544_HAL::markDirty(int16_t x, int16_t y, int16_t w, int16_t h) {
+	if (x < 0) {
+		w += x;
+		x = 0;
+	}
+	if (y < 0) {
+		h += y;
+		y = 0;
+	}
+	if (x + w > PCD8544_VWIDTH)
+		w = PCD8544_VWIDTH - x;
+	if (y + h > PCD8544_VHEIGHT)
+		h = PCD8544_VHEIGHT - y;
+	if (w <= 0 || h <= 0)
+		return;
+	for (int b=y/8; b<=(y+h-1)/8; b++) {
+		if (dirtyFrom[b] > x)
+			dirtyFrom[b] = x;
+		if (dirtyTo[b] < x+w)
+			dirtyTo[b] = x+w;
+	}
+}
+
+void AF_PCD8544_HAL::compose() {
+	if (background) {
+		for (int b=0; b<PCD8544_VHEIGHT/8; b++) {
+			uint8_t *p = &pcd8544_buffer[b*PCD8544_VWIDTH];
+			const uint8_t *bg = &background[b*PCD8544_VWIDTH];
+			int16_t from = dirtyFrom[b];
+			int16_t to = dirtyTo[b];
+			switch (layerOp) {
+			case LAYER_COPY:
+				if (from < to)
+					memcpy(p+from, bg+from, to-from);
+				break;
+			case LAYER_OR:
+				for (int16_t x=from; x<to; x++)
+					p[x] |= bg[x];
+				break;
+			case LAYER_AND:
+				for (int16_t x=from; x<to; x++)
+					p[x] &= bg[x];
+				break;
+			}
+		}
+	}
+	clearDirty();
+}
+
+#if PCD8544_GRAY_PLANES
+void AF_PCD8544_HAL::grayFromCanvas() {
+	planes.fromMono(&pcd8544_buffer[viewX + (viewY/8)*PCD8544_VWIDTH], PCD8544_VWIDTH);
+}
+
+void AF_PCD8544_HAL::startGray(uint8_t period) {
+	sync();
+	grayCount = 0;
+	grayPlane = 0;
+	loadSince = cycles();
+	loadTick = grayStats.tickCycles;
+	loadBusy = stats.busyCycles;
+	grayPeriod = (period > 0) ? period : 1;
+}
 
-	data(pcd8544_buffer, sizeof(pcd8544_buffer));
-	
-	digitalWrite(_cs, HIGH);
+void AF_PCD8544_HAL::stopGray() {
+	grayPeriod = 0;
+	sync();
 }
 
+void AF_PCD8544_HAL::grayTick() {
+	if (!grayActive())
+		return;
+	uint32_t start = cycles();
+	grayStats.ticks++;
+	if (++grayCount >= grayPeriod) {
+		// not into the middle of the commands the main thread is queueing
+		if (busy() || queueTaken || cmdlen != 0) {
+			grayStats.skipped++;
+		} else {
+			grayCount = 0;
+			command(PCD8544_SETYADDR | 0);
+			command(PCD8544_SETXADDR | 0);
+			stream(planes.plane[grayPlane], Gray::PLANE_SZ, 0, 1, 0);
+			grayPlane = (grayPlane + 1) % Gray::PLANES;
+			grayStats.planes++;
+		}
+	}
+	grayStats.tickCycles += cycles() - start;
+}
+
+void AF_PCD8544_HAL::grayLoad(uint8_t &cpu, uint8_t &bus) {
+	uint32_t now = cycles();
+	uint32_t elapsed = now - loadSince;
+	uint32_t tick = grayStats.tickCycles;
+	uint32_t busyNow = stats.busyCycles;
+	if (elapsed > 0) {
+		cpu = uint64_t(tick - loadTick) * 100 / elapsed;
+		bus = uint64_t(busyNow - loadBusy) * 100 / elapsed;
+	} else {
+		cpu = bus = 0;
+	}
+	loadSince = now;
+	loadTick = tick;
+	loadBusy = busyNow;
+}
+#endif
+
 // clear everything
 void AF_PCD8544_HAL::clearDisplay(void) {
-  memset(pcd8544_buffer, 0, LCDWIDTH*LCDHEIGHT/8);
+  sync();
+  memset(pcd8544_buffer, 0, sizeof(pcd8544_buffer));
   cursor_y = cursor_x = 0;
 }
+
+/*** Hooks to HAL C code ******************************/
+
+#ifndef PCD8544_LL
+extern "C" {
+
+	/**
+	 * @brief SPI DMA transfer completion IRQ handler
+	 *
+	 * The name of the function must exactly match to what HAL library expects
+	 */
+	void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi) {
+		if (active)
+			active->transferComplete();
+	}
+
+	/**
+	 * @brief SPI error IRQ handler
+	 *
+	 * The name of the function must exactly match to what HAL library expects
+	 */
+	void HAL_SPI_ErrorCallback(SPI_HandleTypeDef *hspi) {
+		if (active)
+			active->transferError();
+	}
+
+}
+#endif
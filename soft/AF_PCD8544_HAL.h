@@ -37,6 +37,42 @@ Augmented to work with STM32 HAL by Denis Kokarev
 #define LCDWIDTH 84
 #define LCDHEIGHT 48
 
+/*
+ * The virtual canvas we draw on may be larger than the screen to
+ * scroll the viewport over it. It costs PCD8544_VWIDTH*PCD8544_VHEIGHT/8
+ * bytes of RAM, plus LCDWIDTH bytes line buffer when taller than the screen.
+ * The height must be a multiple of 8
+ */
+#ifndef PCD8544_VWIDTH
+#define PCD8544_VWIDTH LCDWIDTH
+#endif
+#ifndef PCD8544_VHEIGHT
+#define PCD8544_VHEIGHT LCDHEIGHT
+#endif
+
+/*
+ * Keep a copy of the canvas in RAM as a background layer
+ * @see AF_PCD8544_HAL::captureBackground()
+ * costs PCD8544_VWIDTH*PCD8544_VHEIGHT/8 bytes of RAM, set to 1 in the builds
+ * of the programs using captureBackground()
+ */
+#ifndef PCD8544_LAYER
+#define PCD8544_LAYER 0
+#endif
+
+/*
+ * Number of bitplanes for temporal-dither grayscale, 2 or 3 give 3 or 4 gray levels
+ * @see AF_PCD8544_HAL::startGray()
+ * costs PCD8544_GRAY_PLANES*LCDWIDTH*LCDHEIGHT/8 bytes of RAM, 0 disables it
+ */
+#ifndef PCD8544_GRAY_PLANES
+#define PCD8544_GRAY_PLANES 0
+#endif
+
+#if PCD8544_GRAY_PLANES
+#include "gray.h"
+#endif
+
 #define PCD8544_POWERDOWN 0x04
 #define PCD8544_ENTRYMODE 0x02
 #define PCD8544_EXTENDEDINSTRUCTION 0x01
@@ -57,6 +93,9 @@ Augmented to work with STM32 HAL by Denis Kokarev
 #define PCD8544_SETBIAS 0x10
 #define PCD8544_SETVOP 0x80
 
+// how many commands we may queue before pushing them
+#define PCD8544_CMDBUF_SZ 8
+
 /**
  * @brief Combining STM32 pin into a single structure
  */
@@ -70,6 +109,8 @@ struct STM_HAL_Pin {
  *
  * A subclass of a generic Arduino-based Adafruit GFX library
  * to use Nokia LCD display on STM32 HAL platform
+ * Define PCD8544_LL to drive the pins and SPI DMA by registers
+ * instead of HAL library calls
  * @author Limor Fried/Ladyada 
  * @author Denis Kokarev
  */
@@ -94,6 +135,46 @@ class AF_PCD8544_HAL : public Adafruit_GFX {
 	 * @brief send contrast command to the screen
 	 */
 	void setContrast(uint8_t val);
+	/**
+	 * @brief how the controller shows its RAM
+	 */
+	enum Effect {
+		EFFECT_NORMAL = PCD8544_DISPLAYNORMAL,		///< as drawn
+		EFFECT_INVERT = PCD8544_DISPLAYINVERTED,	///< black and white swapped
+		EFFECT_BLANK = PCD8544_DISPLAYBLANK,		///< all white
+		EFFECT_ALLON = PCD8544_DISPLAYALLON			///< all black
+	};
+	/**
+	 * @brief switch the screen into the effect mode
+	 *
+	 * Costs one command byte, the buffer and the controller RAM stay intact,
+	 * so EFFECT_NORMAL brings the picture back without redrawing
+	 */
+	void setEffect(Effect e);
+	/**
+	 * @brief current effect mode
+	 */
+	Effect getEffect() const {
+		return effect;
+	}
+	/**
+	 * @brief hide the screen content
+	 *
+	 * Anything display()-ed afterwards goes to the controller RAM invisibly
+	 * until reveal(), so a new window appears at once instead of being
+	 * painted over the old one
+	 */
+	void blank() {
+		setEffect(EFFECT_BLANK);
+	}
+	/**
+	 * @brief show what was display()-ed since blank()
+	 *
+	 * Takes effect after the frames queued before it
+	 */
+	void reveal() {
+		setEffect(EFFECT_NORMAL);
+	}
 	/**
 	 * @brief clear display buffer (but don't refresh the screen)
 	 */ 
@@ -104,40 +185,387 @@ class AF_PCD8544_HAL : public Adafruit_GFX {
 	 * The primary function to copy the entire buffer to the screen.
 	 * Use it every time you want to update screen content after series of
 	 * drawing functions, such as drawLine(), print(), etc
+	 * The transfer goes in background and the function returns right after
+	 * starting it. Drawing while it is in progress may show up partially
+	 * until the next display()
+	 * Does nothing in grayscale mode, the planes are on the screen then
 	 */
 	void display();
+	/**
+	 * @brief push only the screen banks the canvas rectangle touches
+	 *
+	 * Every bank row goes to its own place with 2 address command bytes
+	 * ahead of it, so it pays off for the regions narrower than the screen.
+	 * Asynchronous as display()
+	 */
+	void displayRect(int16_t x, int16_t y, int16_t w, int16_t h);
+	/**
+	 * @brief move the screen over the virtual canvas
+	 *
+	 * Takes effect on the next display(). Scrolling by whole columns or
+	 * 8 pixel banks costs nothing, otherwise the banks get shifted on the fly
+	 * @param x - canvas column to show in the leftmost screen column
+	 * @param y - canvas row to show in the topmost screen row
+	 */
+	void setViewport(int16_t x, int16_t y);
+	/**
+	 * @brief canvas column in the leftmost screen column
+	 */
+	int16_t getViewportX() const {
+		return viewX;
+	}
+	/**
+	 * @brief canvas row in the topmost screen row
+	 */
+	int16_t getViewportY() const {
+		return viewY;
+	}
+	/**
+	 * @brief how the background layer gets combined with the canvas
+	 */
+	enum LayerOp {
+		LAYER_COPY,	///< the canvas is reset to the background
+		LAYER_OR,	///< the background black pixels show through
+		LAYER_AND	///< the background white pixels punch holes
+	};
+	/**
+	 * @brief set the static background layer
+	 *
+	 * @param bg - image of the canvas size and layout, may stay in flash, nullptr to have no background
+	 * @param op - how to combine it with the canvas
+	 */
+	void setBackground(const uint8_t *bg, LayerOp op = LAYER_OR);
+#if PCD8544_LAYER
+	/**
+	 * @brief keep what's on the canvas now as the static background layer
+	 *
+	 * Paint the static part once then capture it. Afterwards only compose() it
+	 * under the dynamic content
+	 * @param op - how to combine it with the canvas
+	 */
+	void captureBackground(LayerOp op = LAYER_OR);
+#endif
+	/**
+	 * @brief mark the canvas region for the next compose()
+	 *
+	 * The coordinates are the canvas ones without rotation
+	 */
+	void markDirty(int16_t x, int16_t y, int16_t w, int16_t h);
+	/**
+	 * @brief combine the background layer with the canvas in the dirty regions only
+	 *
+	 * Clears the dirty regions afterwards
+	 */
+	void compose();
 	/**
 	 * @brief check the pixel in the buffer
 	 */
-	uint8_t getPixel(int8_t x, int8_t y);
+	uint8_t getPixel(int16_t x, int16_t y);
 	/**
 	 * @brief draw one pixel in the buffer, which unlocks potential of all other Adafruit_GFX functions
 	 */
 	void drawPixel(int16_t x, int16_t y, uint16_t color) override;
 	/**
-	 * @brief send command code to the screen
+	 * @brief fill the rectangle by whole column bytes
+	 *
+	 * Falls back to Adafruit_GFX pixel by pixel filling when rotated
+	 */
+	void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) override;
+	/**
+	 * @brief copy column bytes into one bank of the buffer
+	 *
+	 * The fastest way to put 8 pixel high images, such as tiles, on the screen
+	 * @param x - leftmost column
+	 * @param bank - which 8 pixel row, 0..PCD8544_VHEIGHT/8-1
+	 * @param cols - column bytes, LSB on top
+	 * @param w - number of columns
+	 */
+	void drawBank(int16_t x, uint8_t bank, const uint8_t *cols, uint8_t w);
+	/**
+	 * @brief expand a packed image straight into the buffer
+	 *
+	 * The image must fit entirely, it is not clipped
+	 * @see unpack.h
+	 * @param x - leftmost column
+	 * @param bank - top 8 pixel row
+	 * @param packed - the image made by vgame-pack tool
+	 * @return false if it doesn't fit, nothing is drawn then
+	 */
+	bool drawPacked(int16_t x, uint8_t bank, const uint8_t *packed);
+	/**
+	 * @brief the canvas bytes, banks of PCD8544_VWIDTH column bytes
+	 *
+	 * For the code working on the bank layout directly, e.g. life_step().
+	 * display() streams from here, so sync() before changing it
+	 */
+	uint8_t *getBuffer() {
+		return pcd8544_buffer;
+	}
+	/**
+	 * @brief print one character at the cursor
+	 * @see write(const uint8_t*, size_t)
+	 */
+	void write(uint8_t c) override;
+	/**
+	 * @brief print a string at the cursor
+	 *
+	 * The fast text path for the classic 6x8 font. Glyph columns are copied
+	 * straight into the buffer when the cursor y is a multiple of 8 and
+	 * shifted and merged into two banks otherwise. Falls back to the
+	 * pixel-by-pixel Adafruit_GFX rendering for scaled, rotated, custom font
+	 * or clipped text
+	 */
+	void write(const uint8_t *buf, size_t sz) override;
+	/**
+	 * @brief queue command code to the screen
+	 *
+	 * The commands are accumulated and pushed as a single SPI transfer
+	 * either by flush() or ahead of the next data()
 	 */
 	void command(uint8_t c);
 	/**
-	 * @brief send a data block to the screen
+	 * @brief push all queued commands to the screen (asynchronously)
+	 */
+	void flush();
+	/**
+	 * @brief push all queued commands followed by a data block to the screen
+	 *
+	 * Both go as one asynchronous operation via DMA - the data transfer is started
+	 * from the commands transfer completion interrupt. The block must stay intact until
+	 * the transfer finishes
+	 * @see sync()
 	 */
 	void data(uint8_t *p, uint16_t sz);
+	/**
+	 * @brief wait until all started transfers complete
+	 */
+	void sync();
+	/**
+	 * @brief are we still pushing something to the screen
+	 */
+	bool busy() const {
+		return mode != IDLE;
+	}
+	/**
+	 * @brief to be invoked from HAL SPI transfer completion interrupt
+	 *
+	 * starts the next phase of the transfer if any
+	 */
+	void transferComplete();
+	/**
+	 * @brief to be invoked from HAL SPI error interrupt
+	 *
+	 * abandons the rest of the transfer
+	 */
+	void transferError();
+	/**
+	 * @brief SPI device we're attached to
+	 */
+	SPI_HandleTypeDef &spi() const {
+		return _hspi;
+	}
+	/**
+	 * @brief SPI usage statistics
+	 *
+	 * The cycles are of the CPU clock running then, one transfer is at one
+	 * clock as it's waited for before the clock changes
+	 */
+	struct Stats {
+		uint32_t frames;		///< number of display() invocations
+		uint32_t setupCycles;	///< CPU cycles spent in all display() calls
+		uint32_t transfers;		///< number of SPI transfers started
+		uint32_t bytes;			///< number of bytes sent via SPI
+		uint32_t busyCycles;	///< CPU cycles while CS was held low
+	};
+	/**
+	 * @brief what did it cost to push frames so far
+	 */
+	const Stats &getStats() const {
+		return stats;
+	}
+	/**
+	 * @brief frame notification, done=false when display() or displayRect() starts the frame
+	 * and done=true from the interrupt once the transfer completes
+	 */
+	typedef void (*FrameHook)(bool done);
+	/**
+	 * @brief get notified about the frames, e.g. to measure the latency, nullptr to stop
+	 */
+	void setFrameHook(FrameHook hook) {
+		frameHook = hook;
+	}
+
+#if PCD8544_GRAY_PLANES
+	typedef GrayPlanes<PCD8544_GRAY_PLANES, LCDWIDTH, LCDHEIGHT> Gray;	///< the grayscale screen
+	/**
+	 * @brief the bitplanes shown in grayscale mode
+	 *
+	 * May be painted any time, the changes show up within one plane cycle
+	 */
+	Gray &gray() {
+		return planes;
+	}
+	/**
+	 * @brief make all planes a copy of the canvas under the viewport
+	 *
+	 * Paint the picture as usual then add the gray pixels on top of it.
+	 * The viewport row is rounded down to the bank
+	 */
+	void grayFromCanvas();
+	/**
+	 * @brief show the bitplanes in turn from grayTick()
+	 *
+	 * Nothing else may be pushed to the screen until stopGray(), and the
+	 * SysTick interrupt must keep running
+	 * @param period - ms between planes, each plane takes ~0.9ms of SPI at 4.5MHz
+	 */
+	void startGray(uint8_t period = 4);
+	/**
+	 * @brief back to monochrome, display() the canvas afterwards
+	 */
+	void stopGray();
+	/**
+	 * @brief are the planes being shown
+	 */
+	bool grayActive() const {
+		return grayPeriod != 0;
+	}
+	/**
+	 * @brief to be invoked every ms from SysTick interrupt
+	 *
+	 * Starts the next plane transfer when its time comes. A busy bus, or
+	 * the commands the main thread is queueing, postpone the plane to the next tick
+	 */
+	void grayTick();
+	/**
+	 * @brief grayscale scheduler counters
+	 */
+	struct GrayStats {
+		uint32_t ticks;			///< grayTick() invocations
+		uint32_t planes;		///< planes pushed
+		uint32_t skipped;		///< ticks postponed by busy bus
+		uint32_t tickCycles;	///< CPU cycles spent in grayTick()
+	};
+	/**
+	 * @brief what the grayscale mode did so far
+	 */
+	const GrayStats &getGrayStats() const {
+		return grayStats;
+	}
+	/**
+	 * @brief CPU and SPI bus load since the previous call or startGray()
+	 *
+	 * Poll it once in a while, it must happen within a minute at 72MHz
+	 * @param[out] cpu - % of CPU time in grayTick()
+	 * @param[out] bus - % of time the screen was selected
+	 */
+	void grayLoad(uint8_t &cpu, uint8_t &bus);
+#endif
+
+	/**
+	 * @brief what are we pushing via SPI now
+	 */
+	enum Mode {
+		IDLE = 0,	///< nothing, CS is released
+		COMMAND,	///< commands, DC is low
+		DATA		///< data, DC is high
+	};
   
  protected:
 	SPI_HandleTypeDef &_hspi;	///< SPI device handler
 	const STM_HAL_Pin &_dc;		///< Data/Command pin
 	const STM_HAL_Pin &_cs;		///< SPI chip select pin
 	const STM_HAL_Pin &_rst;	///< Reset pin
-	uint8_t pcd8544_buffer[LCDWIDTH * LCDHEIGHT / 8]; ///< screen buffer to hold all pixels
+	uint8_t pcd8544_buffer[PCD8544_VWIDTH * PCD8544_VHEIGHT / 8]; ///< canvas buffer to hold all pixels
+	/**
+	 * @brief render one character of the classic font into the buffer
+	 * @param x - left column of the character cell
+	 * @param y - top row of the character cell
+	 * @param c - character code
+	 */
+	void drawGlyph(int16_t x, int16_t y, uint8_t c);
 	/**
-	 * @brief what did we push via SPI last time
+	 * @brief what are we pushing via SPI now
 	 * 
 	 * This flag is necessary to prevent _dc pin change before all commands or all data
-	 * finish transmission
+	 * finish transmission. It is updated from the transfer completion interrupt
 	 * @see command()
 	 * @see data()
 	 */
-	uint8_t mode;
+	volatile uint8_t mode;
+	uint8_t cmdbuf[PCD8544_CMDBUF_SZ];	///< queued commands
+	uint8_t cmdlen;						///< how many commands queued
+	volatile bool queueTaken;			///< command(), flush() or stream() is changing the queue, grayTick() keeps off
+	uint8_t *row;						///< next data row to be pushed after commands
+	uint16_t rowSz;						///< row size
+	uint16_t rowStride;					///< distance between rows
+	uint8_t rows;						///< how many rows to push
+	uint8_t rowShift;					///< shift rows down by that many pixels
+	int16_t rowX;						///< screen column of every row, -1 when the rows follow each other
+	uint8_t rowBank;					///< screen bank of the next row
+	bool rowAddrDue;					///< the next row needs its address first
+	uint8_t rowCmd[2];					///< the next row address commands
+	Stats stats;						///< SPI usage counters
+	FrameHook frameHook;				///< frame start and completion callback
+	uint32_t busySince;					///< when CS went low
+	int16_t viewX;						///< viewport column
+	int16_t viewY;						///< viewport row
+	const uint8_t *background;			///< static background layer
+	uint8_t layerOp;					///< how to combine the background with the canvas
+	Effect effect;						///< current display control mode
+	int16_t dirtyFrom[PCD8544_VHEIGHT/8];	///< first dirty column in each bank
+	int16_t dirtyTo[PCD8544_VHEIGHT/8];		///< past the last dirty column in each bank
+#if PCD8544_LAYER
+	uint8_t layer[PCD8544_VWIDTH * PCD8544_VHEIGHT / 8];	///< captured background
+#endif
+	/**
+	 * @brief nothing to compose
+	 */
+	void clearDirty();
+#if PCD8544_VHEIGHT > LCDHEIGHT
+	uint8_t line[LCDWIDTH];				///< shifted row being pushed
+#endif
+#if PCD8544_GRAY_PLANES
+	Gray planes;						///< grayscale bitplanes
+	volatile uint8_t grayPeriod;		///< ms between planes, 0 in monochrome mode
+	uint8_t grayCount;					///< ms since the last plane
+	uint8_t grayPlane;					///< the plane to show next
+	GrayStats grayStats;				///< grayscale scheduler counters
+	uint32_t loadSince;					///< start of grayLoad() window
+	uint32_t loadTick;					///< grayStats.tickCycles at loadSince
+	uint32_t loadBusy;					///< stats.busyCycles at loadSince
+#endif
+	/**
+	 * @brief a frame is about to go, the previous transfer finished first
+	 */
+	void frameStart();
+	/**
+	 * @brief pull CS low and make us the target of SPI interrupts
+	 */
+	void select();
+	/**
+	 * @brief push a sequence of data rows after the queued commands
+	 *
+	 * Each row goes as a separate DMA transfer started from the previous
+	 * one completion interrupt
+	 * @param p - first row
+	 * @param sz - row size
+	 * @param stride - distance to the next row
+	 * @param n - number of rows
+	 * @param shift - when non-zero the rows are merged with the next ones shifted up by that many pixels
+	 * @param x - when non-negative every row is addressed to this screen column
+	 * @param bank - the screen bank of the first addressed row
+	 */
+	void stream(uint8_t *p, uint16_t sz, uint16_t stride, uint8_t n, uint8_t shift, int16_t x = -1, uint8_t bank = 0);
+	/**
+	 * @brief advance to the next row
+	 * @return what to push
+	 */
+	uint8_t *nextRow();
+	/**
+	 * @brief start one DMA transfer in the given mode
+	 */
+	void transmit(uint8_t m, uint8_t *p, uint16_t sz);
 };
 
 #endif
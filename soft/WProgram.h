@@ -17,9 +17,16 @@ typedef char* __FlashStringHelper;
  */
 struct Print {
 	virtual void write(uint8_t) = 0;
+	/**
+	 * write a block of characters at once
+	 * the devices which can do better than char-by-char should override it
+	 */
+	virtual void write(const uint8_t *buf, size_t sz) {
+		while (sz--)
+			write(*buf++);
+	}
 	void print(const char *s) {
-		while (*s)
-			write(*s++);
+		write(reinterpret_cast<const uint8_t*>(s), strlen(s));
 	}
 };
 
@@ -0,0 +1,53 @@
+/**
+ * @file
+ * @brief CPU cycle counter to profile our code
+ *
+ * Thin wrapper around Cortex-M4 DWT cycle counter
+ * @author Denis Kokarev
+ */
+#ifndef _CYCLES_H
+#define _CYCLES_H
+
+#include <cstdint>
+#include "stm32f3xx_hal.h"
+
+#ifdef HOST
+
+#include <chrono>
+
+/*
+ * on host a "cycle" is one nanosecond
+ */
+inline void cycles_init() {
+}
+
+inline uint32_t cycles() {
+	auto t = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+}
+
+#else
+
+/**
+ * @brief start counting CPU cycles
+ *
+ * must be invoked once before any cycles() readings make sense
+ */
+inline void cycles_init() {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+/**
+ * @brief current CPU cycle count
+ *
+ * wraps every ~60sec at 72MHz, so use only the differences
+ */
+inline uint32_t cycles() {
+	return DWT->CYCCNT;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @brief Bitplanes for temporal-dither grayscale
+ *
+ * The 1-bit LCD shows gray when its pixels alternate faster than
+ * the eye can follow. A pixel of level L is on in L planes out of P,
+ * so showing the planes in turn gives P+1 visible levels
+ * @author Denis Kokarev
+ */
+#ifndef _GRAY_H
+#define _GRAY_H
+
+#include <cstdint>
+#include <cstring>
+
+/**
+ * @brief P bitplanes of W x H pixels in PCD8544 bank layout
+ *
+ * Pure data with no hardware dependencies
+ * @tparam P - number of planes
+ * @tparam W - width in pixels
+ * @tparam H - height in pixels, multiple of 8
+ */
+template<int P, int W, int H>
+struct GrayPlanes {
+	static constexpr int PLANES = P;			///< number of planes
+	static constexpr int LEVELS = P+1;			///< number of gray levels, 0 - white, P - black
+	static constexpr int PLANE_SZ = W*H/8;		///< bytes in one plane
+	uint8_t plane[P][PLANE_SZ];					///< the planes to be shown in turn
+
+	/**
+	 * @brief all planes become the same monochrome picture
+	 * @param mono - top left bank byte of the picture
+	 * @param stride - distance between the banks of the picture
+	 */
+	void fromMono(const uint8_t *mono, int stride) {
+		for (int b=0; b<H/8; b++)
+			for (int p=0; p<P; p++)
+				memcpy(&plane[p][b*W], &mono[b*stride], W);
+	}
+	/**
+	 * @brief set the pixel gray level
+	 * @param level - 0 (white) .. P (black)
+	 */
+	void setPixel(int16_t x, int16_t y, uint8_t level) {
+		if ((x < 0) || (x >= W) || (y < 0) || (y >= H))
+			return;
+		int i = x + (y/8)*W;
+		uint8_t bit = 1 << (y%8);
+		for (int p=0; p<P; p++) {
+			if (p < level)
+				plane[p][i] |= bit;
+			else
+				plane[p][i] &= ~bit;
+		}
+	}
+	/**
+	 * @brief the pixel gray level
+	 */
+	uint8_t getPixel(int16_t x, int16_t y) const {
+		if ((x < 0) || (x >= W) || (y < 0) || (y >= H))
+			return 0;
+		int i = x + (y/8)*W;
+		uint8_t level = 0;
+		for (int p=0; p<P; p++)
+			level += (plane[p][i] >> (y%8)) & 1;
+		return level;
+	}
+	/**
+	 * @brief paint the rectangle with the gray level
+	 */
+	void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint8_t level) {
+		for (int16_t j=y; j<y+h; j++)
+			for (int16_t i=x; i<x+w; i++)
+				setPixel(i, j, level);
+	}
+};
+
+#endif
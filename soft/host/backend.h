@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @brief The same drawing on both LCD driver backends
+ *
+ * vgame-host runs it on the HAL backend and on PCD8544_LL one, which
+ * host/ll_driver.cpp builds once more as AF_PCD8544_LL, and compares what
+ * goes over the LCD bus, @see host_bus_record()
+ * @author Denis Kokarev
+ */
+#ifndef _HOST_BACKEND_H
+#define _HOST_BACKEND_H
+
+#include "AF_PCD8544_HAL.h"
+
+/**
+ * @brief reset, commands, full and partial frames
+ *
+ * From a clear buffer, the drawing waits for the frames, so late DMA sends the same pixels
+ */
+template<typename D>
+void backendScenario(D &d) {
+	d.begin();
+	d.clearDisplay();
+	d.setTextColor(BLACK, WHITE);
+	d.setCursor(3, 5);
+	d.print("HAL vs LL");
+	d.fillRect(10, 20, 30, 12, BLACK);
+	d.display();
+	d.sync();
+	d.drawLine(0, 47, 83, 0, BLACK);
+	d.displayRect(20, 10, 40, 20);
+	d.setContrast(50);
+	d.setEffect(D::EFFECT_INVERT);
+	d.setEffect(D::EFFECT_NORMAL);
+	for (int i=0; i<2*PCD8544_CMDBUF_SZ+1; i++)
+		d.command(PCD8544_SETXADDR | i);
+	d.display();
+	d.sync();
+}
+
+/**
+ * @brief backendScenario() on a fresh PCD8544_LL backend display, host/ll_driver.cpp
+ */
+void host_ll_scenario();
+
+#endif
@@ -0,0 +1,1402 @@
+/**
+ * @file
+ * @brief Rendering benchmark for the host build
+ *
+ * Times the typical drawing calls of our games on AF_PCD8544_HAL,
+ * counts what would go over SPI and optionally dumps every frame
+ *
+ * usage: vgame-host [-n iterations] [-p pbm_prefix | -t]
+ * @author Denis Kokarev
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <string>
+#include "AF_PCD8544_HAL.h"
+#include "tilemap.h"
+#include "widgets.h"
+#include "cycles.h"
+#include "unpack.h"
+#include "life.h"
+#include "spsc.h"
+#include "keypad.h"
+#include "timerwheel.h"
+#include "task.h"
+#include "windowset.h"
+#include "latency.h"
+#include "rtctime.h"
+#include "program.h"
+#include "pack.h"
+#include "pcd8544_host.h"
+#include "backend.h"
+
+/*
+ * all of these must match program.cpp
+ */
+static SPI_HandleTypeDef hspi1;
+const static STM_HAL_Pin dc {GPIOB, GPIO_PIN_7};
+const static STM_HAL_Pin cs {GPIOB, GPIO_PIN_6};
+const static STM_HAL_Pin rst {GPIOA, GPIO_PIN_15};
+
+static AF_PCD8544_HAL display(hspi1, dc, cs, rst);
+
+/**
+ * @brief one benchmark case
+ */
+struct Bench {
+	const char *name;		///< what we measure
+	void (*fn)();			///< one iteration of it
+};
+
+static const char line[] = "Reversy v0.9 !";
+
+static void clear() {
+	display.clearDisplay();
+}
+
+static void textAligned() {
+	display.setTextColor(BLACK, WHITE);
+	for (int y=0; y<LCDHEIGHT; y+=8) {
+		display.setCursor(0, y);
+		display.print(line);
+	}
+}
+
+static void textShifted() {
+	display.setTextColor(WHITE, BLACK);
+	for (int y=3; y<LCDHEIGHT-8; y+=8) {
+		display.setCursor(0, y);
+		display.print(line);
+	}
+}
+
+/// the same text as textAligned() via Adafruit_GFX pixel by pixel rendering
+static void textPixels() {
+	for (int y=0; y<LCDHEIGHT; y+=8)
+		for (int i=0; line[i]; i++)
+			display.drawChar(i*6, y, line[i], BLACK, WHITE, 1);
+}
+
+/// what reversy drawGrid() does
+static void grid() {
+	for (int n=0; n<7; n++) {
+		display.drawLine(0, 6*n+5, 55, 6*n+5, BLACK);
+		display.drawLine(7*n+6, 0, 7*n+6, 47, BLACK);
+	}
+}
+
+#if PCD8544_LAYER
+/// the same grid composed from the background layer
+static void gridLayer() {
+	display.markDirty(0, 0, 56, 48);
+	display.compose();
+}
+#endif
+
+#if PCD8544_GRAY_PLANES
+/// every gray level as a vertical stripe over the mono picture
+static void grayStripes() {
+	display.grayFromCanvas();
+	AF_PCD8544_HAL::Gray &g = display.gray();
+	for (int l=0; l<AF_PCD8544_HAL::Gray::LEVELS; l++)
+		g.fillRect(l*8, 8, 8, 32, l);
+}
+#endif
+
+static void fill() {
+	display.fillRect(0, 0, LCDWIDTH, LCDHEIGHT, BLACK);
+}
+
+static constexpr Button button {"START", LCDWIDTH/2, LCDHEIGHT/4*3};
+
+static void buttons() {
+	button.draw(display);
+	button.draw(display, true);
+}
+
+static const TileMap<6>::Tile tiles[2] = {
+	{0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+	{0x3c, 0x42, 0x81, 0x81, 0x42, 0x3c},
+};
+static TileMap<6> tilemap(tiles);
+
+static void tilesFull() {
+	tilemap.invalidate();
+	tilemap.draw(display);
+}
+
+/// text screen packed by packScenes()
+static std::vector<uint8_t> packedText;
+
+static void unpackText() {
+	display.drawPacked(0, 0, packedText.data());
+}
+
+/// invert and back, a flash without the delay
+static void effects() {
+	display.setEffect(AF_PCD8544_HAL::EFFECT_INVERT);
+	display.setEffect(AF_PCD8544_HAL::EFFECT_NORMAL);
+}
+
+/// what a button press animation frame pushes
+static void frameButton() {
+	display.displayRect(button.x, button.y, button.w, button.h);
+	display.sync();
+}
+
+/// one Life generation on the whole canvas
+static void lifeStep() {
+	life_step(display.getBuffer(), PCD8544_VWIDTH, PCD8544_VHEIGHT/8);
+}
+
+/// a LifeProgram generation: wait for the frame, step, push
+static void lifeFrame() {
+	display.sync();
+	lifeStep();
+	display.display();
+}
+
+static void frame() {
+	display.display();
+	display.sync();
+}
+
+/// viewport between the banks, if the canvas is larger than the screen
+static void frameScrolled() {
+	display.setViewport(1, 3);
+	frame();
+	display.setViewport(0, 0);
+}
+
+static const Bench benches[] = {
+	{"clearDisplay", clear},
+	{"print aligned 6x14", textAligned},
+	{"print shifted 5x14", textShifted},
+	{"drawChar 6x14", textPixels},
+	{"drawLine grid", grid},
+#if PCD8544_LAYER
+	{"compose grid layer", gridLayer},
+#endif
+#if PCD8544_GRAY_PLANES
+	{"gray stripes", grayStripes},
+#endif
+	{"fillRect screen", fill},
+	{"Button draw+pressed", buttons},
+	{"TileMap full redraw", tilesFull},
+	{"drawPacked text screen", unpackText},
+	{"setEffect invert+normal", effects},
+	{"life_step", lifeStep},
+	{"life_step+display", lifeFrame},
+	{"display", frame},
+	{"displayRect button", frameButton},
+	{"display scrolled", frameScrolled},
+};
+
+/**
+ * @brief check the fast text path against Adafruit_GFX pixel rendering
+ * @return true if the LCD shows the same
+ */
+static bool textMatches() {
+	uint8_t fast[sizeof(host_lcd().ram)];
+	display.clearDisplay();
+	textAligned();
+	textShifted();
+	frame();
+	memcpy(fast, host_lcd().ram, sizeof(fast));
+	display.clearDisplay();
+	textPixels();
+	for (int y=3; y<LCDHEIGHT-8; y+=8)
+		for (int i=0; line[i]; i++)
+			display.drawChar(i*6, y, line[i], WHITE, BLACK, 1);
+	frame();
+	return memcmp(fast, host_lcd().ram, sizeof(fast)) == 0;
+}
+
+/**
+ * @brief check the byte filling against Adafruit_GFX pixel filling
+ * @return true if random rectangles come out the same
+ */
+static bool fillMatches() {
+	uint8_t fast[sizeof(host_lcd().ram)];
+	srand(1);
+	for (int i=0; i<1000; i++) {
+		int16_t x = rand()%(LCDWIDTH+20) - 10;
+		int16_t y = rand()%(LCDHEIGHT+20) - 10;
+		// Adafruit_GFX draws a stray pixel for zero sizes, so no empty rectangles
+		int16_t w = 1 + rand()%LCDWIDTH;
+		int16_t h = 1 + rand()%LCDHEIGHT;
+		uint16_t color = rand()%2;
+		display.fillRect(x, y, w, h, color);
+		frame();
+		memcpy(fast, host_lcd().ram, sizeof(fast));
+		display.fillRect(x, y, w, h, !color);
+		display.Adafruit_GFX::fillRect(x, y, w, h, color);
+		frame();
+		if (memcmp(fast, host_lcd().ram, sizeof(fast)) != 0)
+			return false;
+	}
+	return true;
+}
+
+static AF_PCD8544_HAL halDisplay(hspi1, dc, cs, rst);	///< fresh one for backendsMatch()
+
+/**
+ * @brief the same drawing on the HAL backend and on the registers of PCD8544_LL one, also with DMA completing late
+ * @return true if the same goes over the LCD bus
+ */
+static bool backendsMatch() {
+	display.sync();
+	std::vector<uint16_t> hal, ll, llLate;
+	host_bus_record(&hal);
+	backendScenario(halDisplay);
+	host_bus_record(&ll);
+	host_ll_scenario();
+	host_dma_defer(true);
+	host_bus_record(&llLate);
+	host_ll_scenario();
+	host_dma_defer(false);
+	host_bus_record(nullptr);
+	printf("LCD bus events: HAL %u, LL %u, LL with late DMA %u\n", unsigned(hal.size()), unsigned(ll.size()), unsigned(llLate.size()));
+	return !hal.empty() && ll == hal && llLate == hal;
+}
+
+/**
+ * @brief queue more commands than cmdbuf holds with DMA completing late
+ * @return true if the controller got all of them in order and the frame after them
+ */
+static bool deferredMatches() {
+	display.sync();
+	host_dma_defer(true);
+	uint32_t expect = host_lcd().cmdHash;
+	uint32_t frames = host_lcd().frames;
+	for (int i=0; i<3*PCD8544_CMDBUF_SZ+3; i++) {
+		uint8_t c = PCD8544_SETXADDR | (i % LCDWIDTH);
+		display.command(c);
+		expect = expect*31 + c;
+	}
+	display.flush();
+	display.sync();
+	bool ok = host_lcd().cmdHash == expect;
+	display.display();
+	display.sync();
+	host_dma_defer(false);
+	return ok && host_lcd().frames == frames + 1;
+}
+
+/**
+ * @brief check the partial updates against the full ones
+ * @return true if random rectangles end up the same on the screen
+ */
+static bool rectMatches() {
+	uint8_t part[sizeof(host_lcd().ram)];
+	srand(2);
+	display.clearDisplay();
+	textAligned();
+	frame();
+	for (int i=0; i<1000; i++) {
+		int16_t x = rand()%(PCD8544_VWIDTH+20) - 10;
+		int16_t y = rand()%(PCD8544_VHEIGHT+20) - 10;
+		int16_t w = 1 + rand()%LCDWIDTH;
+		int16_t h = 1 + rand()%LCDHEIGHT;
+		display.setViewport(rand()%PCD8544_VWIDTH, rand()%PCD8544_VHEIGHT);
+		frame();
+		display.fillRect(x, y, w, h, rand()%2);
+		display.displayRect(x, y, w, h);
+		display.sync();
+		memcpy(part, host_lcd().ram, sizeof(part));
+		frame();
+		if (memcmp(part, host_lcd().ram, sizeof(part)) != 0)
+			return false;
+	}
+	display.setViewport(0, 0);
+	return true;
+}
+
+/**
+ * @brief check life_step() against counting the neighbours cell by cell
+ * @return true if a random field evolves the same for a number of generations
+ */
+static bool lifeMatches() {
+	constexpr int W = PCD8544_VWIDTH;
+	constexpr int H = PCD8544_VHEIGHT;
+	static bool cell[H][W], next[H][W];
+	uint8_t *buf = display.getBuffer();
+	srand(3);
+	for (int y=0; y<H; y++)
+		for (int x=0; x<W; x++)
+			cell[y][x] = rand()%3 == 0;
+	for (int i=0; i<W*H/8; i++)
+		buf[i] = 0;
+	for (int y=0; y<H; y++)
+		for (int x=0; x<W; x++)
+			buf[x + (y/8)*W] |= cell[y][x] << (y%8);
+	for (int g=0; g<100; g++) {
+		lifeStep();
+		for (int y=0; y<H; y++) {
+			for (int x=0; x<W; x++) {
+				int n = 0;
+				for (int dy=-1; dy<=1; dy++)
+					for (int dx=-1; dx<=1; dx++)
+						if (dx || dy)
+							n += cell[(y+dy+H)%H][(x+dx+W)%W];
+				next[y][x] = (n == 3) || (n == 2 && cell[y][x]);
+			}
+		}
+		memcpy(cell, next, sizeof(cell));
+		for (int y=0; y<H; y++)
+			for (int x=0; x<W; x++)
+				if (((buf[x + (y/8)*W] >> (y%8)) & 1) != cell[y][x])
+					return false;
+	}
+	return true;
+}
+
+/**
+ * @brief hammer SpscQueue from two threads, as the interrupts and the main loop do
+ * @return true if everything arrives in order exactly once and the overflow is counted
+ */
+static bool spscStress() {
+	constexpr uint32_t total = 1000000;
+	static SpscQueue<uint32_t, 16> q;
+	std::thread producer([] {
+		// retry on the full queue, every failed attempt is a drop
+		for (uint32_t i=1; i<=total; i++)
+			while (!q.put(i))
+				std::this_thread::yield();
+	});
+	uint32_t received = 0;
+	bool ordered = true;
+	while (received < total) {
+		uint32_t v;
+		if (q.get(v))
+			ordered = ordered && v == ++received;
+		else
+			std::this_thread::yield();
+	}
+	producer.join();
+	uint32_t full = q.getDropped();
+	// overflow of the empty queue by 5
+	for (uint32_t i=0; i<16+5; i++)
+		q.put(i);
+	bool counted = q.getDropped() - full == 5;
+	for (uint32_t i=0, v; q.get(v); i++)
+		counted = counted && v == i;
+	printf("spsc %u passed, %u times full\n", (unsigned)received, (unsigned)full);
+	return ordered && counted && q.empty();
+}
+
+/**
+ * @brief bounce traces of one button, a sample per ms, '1' - contact closed
+ */
+static const char *const bounceTraces[] = {
+	"00001111111111111111111111111111110000000000000000",	// clean press
+	"00010110101111111111111111111111101001010000000000",	// bouncy press and release
+	"00010011011100100000000000000000000000000000000000",	// noise, never 4 in a row
+	"00011111111111111011111111111111110000000000000000",	// press with a dropout
+};
+
+/**
+ * @brief Keypad event as a string, e.g. "2P@17"
+ */
+static std::string keyEvent(uint8_t key, Keypad::Action a, uint8_t n, int t) {
+	static const char actions[] = "PRT";
+	char s[32];
+	snprintf(s, sizeof(s), "%u%c%u@%d ", key, actions[a], n, t);
+	return s;
+}
+
+/**
+ * @brief Keypad debounce without the vertical counters
+ *
+ * A key changes once its new level holds for STABLE_SAMPLES samples
+ * @return the events as keyEvent() strings
+ */
+static std::string debounceReference(const std::vector<uint8_t> &levels) {
+	std::string out;
+	uint8_t state = 0;
+	uint8_t run[8] = {};
+	for (int t=0; t<(int)levels.size(); t++) {
+		for (uint8_t k=0; k<8; k++) {
+			uint8_t bit = 1 << k;
+			if ((levels[t] ^ state) & bit) {
+				if (++run[k] == Keypad::STABLE_SAMPLES) {
+					state ^= bit;
+					run[k] = 0;
+					out += keyEvent(k, (state & bit) ? Keypad::PRESS : Keypad::RELEASE, 0, t);
+				}
+			} else {
+				run[k] = 0;
+			}
+		}
+	}
+	return out;
+}
+
+/**
+ * @brief feed the levels to Keypad
+ * @return the events as keyEvent() strings
+ */
+static std::string debounce(Keypad &kp, const std::vector<uint8_t> &levels) {
+	std::string out;
+	for (int t=0; t<(int)levels.size(); t++)
+		kp.sample(levels[t], [&](uint8_t k, Keypad::Action a, uint8_t n) {
+			out += keyEvent(k, a, n, t);
+		});
+	return out;
+}
+
+/**
+ * @brief check the debouncer on the bounce traces, random noise of 5 keys and a long hold
+ * @return true if it agrees with the reference and repeats on time
+ */
+static bool keypadMatches() {
+	bool ok = true;
+	for (const char *trace: bounceTraces) {
+		std::vector<uint8_t> levels;
+		for (const char *c=trace; *c; c++)
+			levels.push_back(*c == '1');
+		Keypad kp;
+		std::string got = debounce(kp, levels);
+		ok = ok && got == debounceReference(levels) && kp.settled();
+		printf("keys %s -> %s\n", trace, got.c_str());
+	}
+	// 5 keys chattering in bursts
+	std::vector<uint8_t> noise;
+	srand(4);
+	uint8_t held = 0;
+	for (int t=0; t<100000; t++) {
+		if (rand()%50 == 0)
+			held ^= 1 << (rand()%5);
+		noise.push_back(held ^ ((rand()%4 == 0) ? rand()%32 : 0));
+	}
+	noise.insert(noise.end(), 10, 0);
+	Keypad kp;
+	ok = ok && debounce(kp, noise) == debounceReference(noise) && kp.settled();
+	// held for 950ms, repeats at 400ms then every 100ms
+	std::vector<uint8_t> hold(950, 1);
+	hold.insert(hold.end(), 10, 0);
+	Keypad rep(1);
+	std::string got = debounce(rep, hold);
+	ok = ok && got == "0P0@3 0T1@403 0T2@503 0T3@603 0T4@703 0T5@803 0T6@903 0R0@953 ";
+	return ok;
+}
+
+/**
+ * @brief run TimerWheel against a list of due ticks on a simulated clock
+ *
+ * Random starts, cancels and restarts, some of them from the expiry
+ * callbacks, with the clock moving by small steps and by idle jumps to
+ * nextExpiry(), across the 32-bit wrap
+ * @return true if every timer expires exactly on its tick
+ */
+static bool timerWheelMatches() {
+	constexpr int N = 64;
+	struct TestTimer: public WheelTimer {
+		int id;
+	};
+	static TestTimer timers[N];
+	struct Due {
+		bool active;
+		uint32_t at;
+		uint32_t period;
+	} due[N] = {};
+	uint32_t now = 0xfff00000;
+	TimerWheel<> wheel(now);
+	bool ok = true;
+	uint32_t expired = 0, wakeups = 0;
+	srand(5);
+	auto delay = [] {
+		switch (rand()%4) {
+		case 0:
+			return uint32_t(rand()%20);
+		case 1:
+			return uint32_t(rand()%5000);
+		case 2:
+			return uint32_t(rand()%200000);
+		default:
+			return uint32_t(rand()%300);
+		}
+	};
+	auto start = [&](int k, uint32_t at) {
+		uint32_t d = delay();
+		uint32_t period = (rand()%4 == 0) ? 1 + rand()%1000 : 0;
+		// the ticks advanced already are never due
+		uint32_t when = (int32_t(at + d - wheel.time()) < 0) ? wheel.time() : at + d;
+		wheel.start(timers[k], at, d, period);
+		due[k] = {true, when, period};
+	};
+	auto cancel = [&](int k) {
+		wheel.cancel(timers[k]);
+		due[k].active = false;
+	};
+	auto expire = [&](WheelTimer &t) {
+		int k = static_cast<TestTimer&>(t).id;
+		uint32_t tick = wheel.time() - 1;
+		ok = ok && due[k].active && due[k].at == tick && t.active() == (due[k].period != 0);
+		expired++;
+		if (due[k].period)
+			due[k].at += due[k].period;
+		else
+			due[k].active = false;
+		// the callbacks start and cancel too
+		switch (rand()%8) {
+		case 0:
+			cancel(rand()%N);
+			break;
+		case 1:
+			start(rand()%N, tick);
+			break;
+		}
+	};
+	for (int k=0; k<N; k++)
+		timers[k].id = k;
+	for (int i=0; i<200000; i++) {
+		int k = rand()%N;
+		switch (rand()%4) {
+		case 0:
+			cancel(k);
+			break;
+		case 1:
+			start(k, now);
+			break;
+		default:
+			if (!wheel.empty() && rand()%2) {
+				uint32_t next = wheel.nextExpiry();
+				for (const Due &d: due)
+					ok = ok && (!d.active || int32_t(d.at - next) >= 0);
+				ok = ok && int32_t(next - now) > 0;
+				now = next;
+				wakeups++;
+			} else {
+				now += rand()%50;
+			}
+			wheel.advance(now, expire);
+			for (const Due &d: due)
+				ok = ok && (!d.active || int32_t(d.at - now) > 0);
+		}
+	}
+	int active = 0;
+	for (int k=0; k<N; k++)
+		active += due[k].active;
+	ok = ok && (active == 0) == wheel.empty();
+	printf("timer wheel %u expired, %u idle wakeups, %d running\n", (unsigned)expired, (unsigned)wakeups, active);
+	return ok;
+}
+
+/**
+ * @brief a task that wakes up 3 times 10 ticks apart
+ */
+class SleepyTask: public Task {
+public:
+	std::string *trace;		///< where to log
+	int i;					///< loop counter, kept across the slices
+	bool half;				///< woke up twice
+	void run() override {
+		TASK_BEGIN();
+		for (i=0; i<3; i++) {
+			*trace += "A" + std::to_string(i) + "@" + std::to_string(now) + " ";
+			half = i == 1;
+			TASK_SLEEP(10);
+		}
+		TASK_END();
+	}
+};
+
+/**
+ * @brief a task waiting for SleepyTask, then yielding once
+ */
+class WaitingTask: public Task {
+public:
+	std::string *trace;				///< where to log
+	const SleepyTask *other;		///< what to wait for
+	void run() override {
+		TASK_BEGIN();
+		TASK_WAIT_UNTIL(other->half);
+		*trace += "B@" + std::to_string(now) + " ";
+		TASK_YIELD();
+		*trace += "B2@" + std::to_string(now) + " ";
+		TASK_END();
+	}
+};
+
+/**
+ * @brief run the tasks on a simulated clock, jumping over the idle stretches
+ * @return true if they interleave as expected and the slots are reused
+ */
+static bool tasksMatch() {
+	std::string trace;
+	static SleepyTask a;
+	static WaitingTask b, extra;
+	a.trace = b.trace = &trace;
+	b.other = &a;
+	TaskScheduler<2> sched;
+	bool ok = sched.spawn(a) && sched.spawn(b) && !sched.spawn(extra);
+	uint32_t now = 100;
+	while (!sched.empty() && now < 1000) {
+		if (sched.run(now)) {
+			now++;
+		} else {
+			uint32_t next = now + 1000;
+			sched.nextWake(next);
+			now = next;
+		}
+	}
+	printf("tasks %s\n", trace.c_str());
+	ok = ok && trace == "A0@100 A1@110 B@110 B2@111 A2@120 ";
+	ok = ok && !a.running() && !b.running() && sched.empty();
+	// b polls once per wakeup, at 100, 101 and 110 till A1, then yields once
+	ok = ok && a.getStats().slices == 4 && b.getStats().slices == 4;
+	// killed in the middle and spawned again from the start
+	trace.clear();
+	sched.spawn(a);
+	sched.run(0);
+	sched.kill(a);
+	ok = ok && sched.empty() && sched.spawn(a) && sched.run(1);
+	return ok && trace == "A0@0 A0@1 ";
+}
+
+/*
+ * Key presses traced through the debouncer, the handling and the frame
+ * transfer as program.cpp does, on a virtual microsecond clock
+ */
+
+static LatencyTrace latency;	///< the presses of latencyMatches()
+static uint32_t virtualUs;		///< its clock
+static uint32_t frameBytes;		///< SPI bytes sent before the traced frame
+
+/**
+ * @brief AF_PCD8544_HAL frame hook, the host transfer is instant so the clock moves by the SPI time of 4.5MHz
+ */
+static void latencyFrame(bool done) {
+	uint32_t bytes = host_lcd().cmdBytes + host_lcd().dataBytes;
+	if (done) {
+		virtualUs += (bytes - frameBytes)*8*10/45;
+		latency.frameDone(virtualUs);
+	} else {
+		frameBytes = bytes;
+		latency.frameStarted(virtualUs);
+	}
+}
+
+/**
+ * @brief press a key, sample it every 1ms till the debouncer sends the press, and let it go
+ */
+static void latencyPress(Keypad &kp, void (*handle)(int), int n) {
+	latency.press(virtualUs);
+	bool pressed = false;
+	while (!pressed) {
+		virtualUs += 1000;
+		kp.sample(1, [&](uint8_t, Keypad::Action a, uint8_t) {
+			pressed = (a == Keypad::PRESS);
+		});
+	}
+	// the main loop wakes up and takes it
+	virtualUs += 30;
+	latency.dequeued(virtualUs);
+	handle(n);
+	while (!kp.settled()) {
+		virtualUs += 1000;
+		kp.sample(0, [](uint8_t, Keypad::Action, uint8_t) {});
+	}
+}
+
+/**
+ * @brief a 1ms bounce, too short for a press, and the idle till the next one
+ * @return false if the debouncer took it for a press
+ */
+static bool latencyGlitch(Keypad &kp) {
+	latency.press(virtualUs);
+	bool pressed = false;
+	uint8_t level = 1;
+	while (level || !kp.settled()) {
+		virtualUs += 1000;
+		kp.sample(level, [&](uint8_t, Keypad::Action a, uint8_t) {
+			pressed = pressed || (a == Keypad::PRESS);
+		});
+		level = 0;
+	}
+	virtualUs += 50000;
+	return !pressed;
+}
+
+/**
+ * @brief 0 - draws from the handler, 1 and 3 - invalidate and render, 2 - no frame
+ */
+static void latencyHandle(int n) {
+	if (n == 0) {
+		virtualUs += 400;
+		display.display();
+		virtualUs += 100;
+		latency.handled(virtualUs);
+	} else {
+		virtualUs += 300;
+		latency.handled(virtualUs);
+		if (n != 2) {
+			virtualUs += 200;
+			display.display();
+		}
+	}
+}
+
+/**
+ * @brief trace 4 presses after a glitch, one of them without a frame
+ * @return true if every stage got the expected time
+ */
+static bool latencyMatches() {
+	display.sync();
+	display.setFrameHook(latencyFrame);
+	Keypad kp;
+	// the trace starts over from the real press
+	bool glitchOk = latencyGlitch(kp);
+	for (int n=0; n<4; n++)
+		latencyPress(kp, latencyHandle, n);
+	display.setFrameHook(nullptr);
+	static const char *const names[] = {"queue", "handle", "render", "spi", "total"};
+	printf("latency us:");
+	for (int st=0; st<LatencyTrace::STAGES; st++) {
+		const LatencyTrace::Histogram &h = latency.get(LatencyTrace::Stage(st));
+		printf(" %s %u/%u", names[st], unsigned(h.n ? h.sumUs/h.n : 0), unsigned(h.maxUs));
+	}
+	printf(" (mean/max), unrendered %u\n", unsigned(latency.getUnrendered()));
+	// 4 samples of the debouncer and the wakeup, 506 bytes of the frame
+	static const uint32_t sums[] = {3*4030, 400+300+300, 0+200+200, 3*899, 3*4030+1000+400+3*899};
+	bool ok = glitchOk && latency.getUnrendered() == 1;
+	for (int st=0; st<LatencyTrace::STAGES; st++) {
+		const LatencyTrace::Histogram &h = latency.get(LatencyTrace::Stage(st));
+		ok = ok && h.n == 3 && h.sumUs == sums[st];
+	}
+	const LatencyTrace::Histogram &render = latency.get(LatencyTrace::RENDER);
+	const LatencyTrace::Histogram &spi = latency.get(LatencyTrace::SPI);
+	return ok && render.count[0] == 1 && render.count[7] == 2 && spi.count[9] == 3;
+}
+
+/*
+ * The early wakeup measured by the RTC calendar as program.cpp does,
+ * on the LSI and the prescalers CubeMX sets
+ */
+
+/**
+ * @brief RTC registers at the time
+ * @param period - RTCCLK periods since midnight
+ * @param[out] tr - TR in BCD
+ * @param[out] ssr - SSR, counting down
+ */
+static void rtcAt(uint64_t period, uint32_t &tr, uint32_t &ssr) {
+	uint64_t tick = period/128;
+	uint32_t sec = (tick/256) % (24*3600);
+	uint32_t h = sec/3600, m = sec/60%60, s = sec%60;
+	tr = (h/10) << 20 | (h%10) << 16 | (m/10) << 12 | (m%10) << 8 | (s/10) << 4 | (s%10);
+	ssr = 255 - tick%256;
+}
+
+/**
+ * @brief sleeps of known length, the midnight included
+ * @return true if the calendar tells them to a subsecond tick
+ */
+static bool rtcMatches() {
+	RtcTime rtc(127 << 16 | 255, 40000);
+	static const uint64_t starts[] = {0, 12345, 40000ull*3600*24 - 20000};
+	static const uint32_t sleeps[] = {3, 100, 1000, 25000};
+	bool ok = true;
+	uint32_t worst = 0;
+	for (uint64_t start: starts) {
+		for (uint32_t ms: sleeps) {
+			uint32_t tr, ssr;
+			rtcAt(start, tr, ssr);
+			uint32_t from = rtc.ticks(tr, ssr);
+			rtcAt(start + uint64_t(ms)*40, tr, ssr);
+			uint32_t got = rtc.elapsedMs(from, rtc.ticks(tr, ssr));
+			uint32_t err = (got > ms) ? got - ms : ms - got;
+			worst = (err > worst) ? err : worst;
+			// one tick is 3.2ms
+			ok = ok && err <= 4;
+		}
+	}
+	printf("rtc early wakeup error %ums at most\n", unsigned(worst));
+	return ok;
+}
+
+/*
+ * A key which skips the animations is for the window it was pressed at,
+ * e.g. ENTER on the game over blink of reversy must not start a new game
+ * from the Again window the blink brings up. Runs program.cpp on the MCU model
+ */
+
+/** @brief what the blink's finish() leads to */
+enum class BlinkEnd: uint8_t {
+	AGAIN,	///< shows the Again window right away
+	STAY,	///< nothing, the board keeps the focus
+	TURN,	///< the machine's turn, which shows the Again window
+	MOVE,	///< the machine's turn, the game goes on
+};
+
+/** @brief the board blinking and the Again window after it */
+class SkipProgram: public WProgram {
+public:
+	static constexpr Event EV_TURN_OVER = Event::EV_CUSTOM;		///< the machine's turn ended the game
+	static constexpr Event EV_TURN = Event::EV_CUSTOM + 1;		///< the machine's turn, the game goes on
+	static constexpr Event EV_DONE = Event::EV_CUSTOM + 2;		///< the test is over
+	/** @brief the final board, blinks */
+	class BoardWindow: public Window, public Animation {
+		SkipProgram &program;
+	public:
+		uint8_t keys;	///< the keys it got
+		explicit BoardWindow(SkipProgram &p):program(p),keys(0) {
+		}
+		Event handleEvent(Event e) override {
+			if (isKey(e))
+				keys++;
+			else if (e == EV_TURN_OVER)
+				program.setMainWindow(&program.again);
+			return Event::EV_NONE;
+		}
+		void draw() override {
+			program.display.fillRect(0, 0, 8, 8, BLACK);
+		}
+		uint16_t step(uint8_t n) override {
+			program.invalidate();
+			if (n < 10)
+				return 100;
+			finish();
+			return 0;
+		}
+		void finish() override {
+			if (program.end == BlinkEnd::AGAIN)
+				program.setMainWindow(&program.again);
+			else if (program.end == BlinkEnd::TURN)
+				events->put(EV_TURN_OVER, EventQueue::LANE_APP);
+			else if (program.end == BlinkEnd::MOVE)
+				events->put(EV_TURN, EventQueue::LANE_APP);
+		}
+	} board;
+	/** @brief ENTER would start a new game */
+	class AgainWindow: public Window {
+	public:
+		uint8_t keys;	///< the keys it got
+		AgainWindow():keys(0) {
+		}
+		Event handleEvent(Event e) override {
+			if (isKey(e))
+				keys++;
+			return Event::EV_NONE;
+		}
+		void draw() override {
+		}
+	} again;
+	BlinkEnd end;
+	Timer press;	///< ENTER in the middle of the blink
+	Timer done;
+	explicit SkipProgram(BlinkEnd e):board(*this),end(e),press(Event::EV_KEY_ENTER),done(EV_DONE) {
+	}
+	void init() override {
+		Program::init();
+		setMainWindow(&board);
+		animate(&board);
+		startTimer(press, 250);
+		startTimer(done, 2000);
+	}
+	Event handleEvent(Event e) override {
+		if (e != EV_DONE)
+			return WProgram::handleEvent(e);
+		cancelTimer(refreshTimer);
+		return Event::EV_CLOSE;
+	}
+	bool onAgain() const {
+		return mainWindow == &again;
+	}
+};
+
+/**
+ * @brief ENTER during the blink, whatever its end leads to
+ * @return true if only the board got it, and only when it kept the focus
+ */
+static bool skipMatches() {
+	static const BlinkEnd ends[] = {BlinkEnd::AGAIN, BlinkEnd::STAY, BlinkEnd::TURN, BlinkEnd::MOVE};
+	static const char *const names[] = {"again", "stay", "turn", "move"};
+	bool ok = true;
+	printf("skipping key to board/again:");
+	for (BlinkEnd end: ends) {
+		SkipProgram p(end);
+		p.execute();
+		bool kept = end == BlinkEnd::STAY || end == BlinkEnd::MOVE;
+		printf(" %s %u/%u", names[int(end)], unsigned(p.board.keys), unsigned(p.again.keys));
+		ok = ok && p.board.keys == (kept ? 1 : 0) && p.again.keys == 0 && p.onAgain() == !kept;
+	}
+	printf("\n");
+	Program::setMainProgram(nullptr);
+	return ok;
+}
+
+/*
+ * A program switched away and back paints its window once on resume(), as
+ * the frame after it has nothing new. Runs program.cpp on the MCU model
+ */
+
+/** @brief passes the control back at once */
+class ReturnProgram: public Program {
+public:
+	ReturnProgram():Program(false) {
+	}
+	Event handleEvent(Event e) override {
+		return back();
+	}
+};
+
+/** @brief counts the draws of its window */
+class ResumeProgram: public WProgram {
+public:
+	static constexpr Event EV_SWITCH = Event::EV_CUSTOM;	///< switchTo() the other program
+	static constexpr Event EV_DONE = Event::EV_CUSTOM + 1;	///< the test is over
+	/** @brief blank, counts its draws */
+	class CountWindow: public Window {
+	public:
+		uint8_t draws;
+		CountWindow():draws(0) {
+		}
+		Event handleEvent(Event e) override {
+			return Event::EV_NONE;
+		}
+		void draw() override {
+			draws++;
+		}
+	} window;
+	ReturnProgram other;
+	Timer done;	///< a while after resume(), so a render() due would happen
+	ResumeProgram():done(EV_DONE) {
+	}
+	void init() override {
+		Program::init();
+		setMainWindow(&window);
+	}
+	void resume() override {
+		WProgram::resume();
+		startTimer(done, 50);
+	}
+	Event handleEvent(Event e) override {
+		if (e == EV_SWITCH)
+			return switchTo(&other);
+		if (e != EV_DONE)
+			return WProgram::handleEvent(e);
+		cancelTimer(refreshTimer);
+		return Event::EV_CLOSE;
+	}
+};
+
+/**
+ * @brief switch to a program and back
+ * @return true if the window is drawn once on init() and once on resume()
+ */
+static bool resumeMatches() {
+	ResumeProgram p;
+	events->put(ResumeProgram::EV_SWITCH, EventQueue::LANE_INPUT);
+	p.execute();
+	events->put(ResumeProgram::EV_SWITCH, EventQueue::LANE_INPUT);
+	p.other.execute();
+	p.execute();
+	Program::setMainProgram(nullptr);
+	printf("window draws on init and resume: %u\n", unsigned(p.window.draws));
+	return p.window.draws == 2;
+}
+
+/*
+ * The same 4 windows on WProgram, dispatched by vtables, and on SWProgram,
+ * dispatched by WindowSet. Each counts its events, ENTER passes the focus on
+ * and the arrows change what they draw, which lives in the program
+ */
+
+static uint32_t windowHits[2][4];	///< events handled by virtual and static windows
+
+/**
+ * @brief what every window does with the event
+ */
+template<int V, int I>
+inline void windowWork(uint8_t *state, Event e) {
+	windowHits[V][I]++;
+	state[windowHits[V][I] % (8*(I+1))] += uint8_t(e);
+}
+
+/**
+ * @brief what every window draws and pushes
+ */
+template<int I>
+inline void windowDraw(AF_PCD8544_HAL &d, uint8_t level) {
+	d.fillRect(0, 0, LCDWIDTH, LCDHEIGHT, WHITE);
+	d.fillRect(I*16, 0, 16, level%LCDHEIGHT + 1, BLACK);
+	d.display();
+}
+
+template<int I>
+class VirtualBenchWindow: public Window {
+	uint8_t state[8*(I+1)];
+public:
+	VirtualBenchWindow():state() {
+	}
+	Event handleEvent(Event e) override;
+	void draw() override;
+};
+
+/** @brief all the windows exist, the main one is pointed to */
+class VirtualWinProgram: public WProgram {
+public:
+	VirtualBenchWindow<0> w0;
+	VirtualBenchWindow<1> w1;
+	VirtualBenchWindow<2> w2;
+	VirtualBenchWindow<3> w3;
+	uint8_t level;	///< what the windows draw
+	VirtualWinProgram():level(0) {
+	}
+	/** @brief init() without the refresh timer, the bench calls handleEvent() and render() itself */
+	void start() {
+		Program::init();
+		cancelTimer(refreshTimer);
+		setMainWindow(&w0);
+	}
+	AF_PCD8544_HAL &screen() {
+		return display;
+	}
+};
+
+static VirtualWinProgram *virtualWinProgram;
+
+template<int I>
+Event VirtualBenchWindow<I>::handleEvent(Event e) {
+	VirtualWinProgram &p = *virtualWinProgram;
+	Window *const all[] = {&p.w0, &p.w1, &p.w2, &p.w3};
+	windowWork<0, I>(state, e);
+	if (e == Event::EV_KEY_ENTER)
+		p.setMainWindow(all[(I+1)%4]);
+	else
+		p.level++;
+	return Event::EV_NONE;
+}
+
+template<int I>
+void VirtualBenchWindow<I>::draw() {
+	windowDraw<I>(virtualWinProgram->screen(), virtualWinProgram->level);
+}
+
+template<int I>
+class StaticBenchWindow: public StaticWindow {
+	uint8_t state[8*(I+1)];
+public:
+	StaticBenchWindow():state() {
+	}
+	Event handleEvent(Event e);
+	void draw();
+};
+
+/** @brief only the main window exists */
+class StaticWinProgram: public SWProgram<StaticBenchWindow<0>, StaticBenchWindow<1>, StaticBenchWindow<2>, StaticBenchWindow<3>> {
+public:
+	uint8_t level;	///< what the windows draw
+	StaticWinProgram():level(0) {
+	}
+	/** @brief init() without the refresh timer, the bench calls handleEvent() and render() itself */
+	void start() {
+		Program::init();
+		cancelTimer(refreshTimer);
+		setMainWindow<StaticBenchWindow<0>>();
+	}
+	AF_PCD8544_HAL &screen() {
+		return display;
+	}
+};
+
+static StaticWinProgram *staticWinProgram;
+
+template<int I>
+Event StaticBenchWindow<I>::handleEvent(Event e) {
+	StaticWinProgram &p = *staticWinProgram;
+	windowWork<1, I>(state, e);
+	if (e == Event::EV_KEY_ENTER)
+		p.setMainWindow<StaticBenchWindow<(I+1)%4>>();
+	else
+		p.level++;
+	return Event::EV_NONE;
+}
+
+template<int I>
+void StaticBenchWindow<I>::draw() {
+	windowDraw<I>(staticWinProgram->screen(), staticWinProgram->level);
+}
+
+/**
+ * @brief one pass of the keys, a frame every 16 of them
+ * @param[in,out] ns - time in handleEvent()
+ * @param[in,out] renderNs - time in render()
+ */
+template<typename P>
+static void windowPass(P &p, const std::vector<Event> &evs, uint64_t &ns, uint64_t &renderNs) {
+	for (size_t i=0; i<evs.size(); i+=16) {
+		uint32_t start = cycles();
+		for (size_t j=i; j<i+16; j++)
+			p.handleEvent(evs[j]);
+		uint32_t handled = cycles();
+		p.render();
+		ns += handled - start;
+		renderNs += cycles() - handled;
+	}
+}
+
+/**
+ * @brief feed the same keys to the both, rendering a frame every 16 of them
+ * @return true if every window got the same events and the screens match either way
+ */
+static bool windowDispatch(int iterations) {
+	static const Event keys[] = {Event::EV_KEY_LEFT, Event::EV_KEY_UP, Event::EV_KEY_DOWN, Event::EV_KEY_RIGHT};
+	std::vector<Event> evs;
+	srand(6);
+	for (int i=0; i<1024; i++)
+		evs.push_back((rand()%16 == 0) ? Event::EV_KEY_ENTER : keys[rand()%4]);
+	VirtualWinProgram vp;
+	StaticWinProgram sp;
+	virtualWinProgram = &vp;
+	staticWinProgram = &sp;
+	vp.start();
+	sp.start();
+	uint64_t ns[2] = {}, renderNs[2] = {};
+	uint32_t bytes[2] = {};
+	std::vector<uint8_t> screens[2];
+	// taking turns, so the host noise hits the both alike
+	for (int n=0; n<iterations; n++) {
+		for (int v=0; v<2; v++) {
+			uint32_t sent = host_lcd().dataBytes;
+			if (v == 0)
+				windowPass(vp, evs, ns[v], renderNs[v]);
+			else
+				windowPass(sp, evs, ns[v], renderNs[v]);
+			bytes[v] += host_lcd().dataBytes - sent;
+			screens[v].assign(host_lcd().ram, host_lcd().ram + sizeof(host_lcd().ram));
+		}
+	}
+	Program::setMainProgram(nullptr);
+	double per = double(iterations)*evs.size();
+	double frames = double(iterations)*evs.size()/16;
+	printf("window dispatch ns/event: virtual %.2f, static %.2f\n", ns[0]/per, ns[1]/per);
+	printf("window render ns/frame: virtual %.2f, static %.2f\n", renderNs[0]/frames, renderNs[1]/frames);
+	printf("window RAM bytes: virtual %u, static %u\n", (unsigned)sizeof(VirtualWinProgram), (unsigned)sizeof(StaticWinProgram));
+	return std::equal(windowHits[0], windowHits[0]+4, windowHits[1]) && bytes[0] == bytes[1] && screens[0] == screens[1];
+}
+
+/**
+ * @brief Life generations per second on this host and what SPI allows on the target
+ */
+static void lifeRate(int iterations) {
+	uint32_t bytes = host_lcd().cmdBytes + host_lcd().dataBytes;
+	uint64_t stepNs = 0, frameNs = 0;
+	for (int i=0; i<iterations; i++) {
+		uint32_t start = cycles();
+		lifeStep();
+		uint32_t stepped = cycles();
+		lifeFrame();
+		stepNs += stepped - start;
+		frameNs += cycles() - stepped;
+	}
+	bytes = host_lcd().cmdBytes + host_lcd().dataBytes - bytes;
+	// one generation is pushed per lifeFrame()
+	double spiBits = 8.0*bytes/iterations;
+	printf("life gens/s: step %.0f, step+display %.0f, SPI bound at 4.5MHz %.0f\n",
+		   1e9*iterations/stepNs, 1e9*iterations/frameNs, 4.5e6/spiBits);
+}
+
+#if PCD8544_GRAY_PLANES
+/**
+ * @brief check the planes cycled by grayTick() add up to the gray levels
+ * @return true if every pixel is dark in as many frames as its level
+ */
+static bool grayMatches() {
+	typedef AF_PCD8544_HAL::Gray Gray;
+	int dark[LCDWIDTH][LCDHEIGHT] = {};
+	display.clearDisplay();
+	textAligned();
+	grayStripes();
+	display.startGray(1);
+	for (int p=0; p<Gray::PLANES; p++) {
+		display.grayTick();
+		display.sync();
+		for (int x=0; x<LCDWIDTH; x++)
+			for (int y=0; y<LCDHEIGHT; y++)
+				dark[x][y] += host_lcd_pixel(x, y);
+	}
+	// a command queued by the main thread keeps the planes off till it's flushed
+	const AF_PCD8544_HAL::GrayStats &gs = display.getGrayStats();
+	uint32_t planes = gs.planes;
+	uint32_t skipped = gs.skipped;
+	display.command(PCD8544_SETYADDR | 0);
+	display.grayTick();
+	bool kept = gs.planes == planes && gs.skipped == skipped + 1;
+	display.flush();
+	display.sync();
+	display.stopGray();
+	uint8_t cpu, bus;
+	display.grayLoad(cpu, bus);
+	printf("gray planes %u, skipped %u, CPU %u%%, SPI %u%%\n", (unsigned)gs.planes, (unsigned)gs.skipped, cpu, bus);
+	for (int x=0; x<LCDWIDTH; x++)
+		for (int y=0; y<LCDHEIGHT; y++)
+			if (dark[x][y] != display.gray().getPixel(x, y))
+				return false;
+	return kept;
+}
+#endif
+
+/**
+ * @brief a screen to pack
+ */
+struct Scene {
+	const char *name;		///< what's on it
+	void (*draw)();			///< paint it
+};
+
+static void sceneText() {
+	textAligned();
+}
+
+static void sceneBoard() {
+	grid();
+	display.setCursor(60, 0);
+	display.print("You");
+	display.setCursor(60, 16);
+	display.print("AI");
+}
+
+static void sceneTiles() {
+	for (int y=0; y<TileMap<6>::ROWS; y++)
+		for (int x=0; x<TileMap<6>::COLS; x++)
+			tilemap.set(x, y, (x+y)%3 == 0);
+	tilesFull();
+}
+
+static void sceneFill() {
+	fill();
+}
+
+static const Scene scenes[] = {
+	{"text", sceneText},
+	{"board", sceneBoard},
+	{"tiles", sceneTiles},
+	{"black", sceneFill},
+};
+
+/**
+ * @brief pack typical screens and check they unpack back the same
+ * @return true if all of them do
+ */
+static bool packScenes() {
+	bool ok = true;
+	for (const Scene &sc: scenes) {
+		display.clearDisplay();
+		sc.draw();
+		frame();
+		uint8_t img[sizeof(host_lcd().ram)];
+		memcpy(img, host_lcd().ram, sizeof(img));
+		std::vector<uint8_t> packed = pack(img, LCDWIDTH, LCDHEIGHT/8);
+		if (sc.draw == sceneText)
+			packedText = packed;
+		display.clearDisplay();
+		display.drawPacked(0, 0, packed.data());
+		frame();
+		bool same = memcmp(img, host_lcd().ram, sizeof(img)) == 0;
+		printf("packed %-8s %4u -> %4u bytes %5.1f%% %s\n", sc.name, (unsigned)sizeof(img), (unsigned)packed.size(),
+			   100.0*packed.size()/sizeof(img), same ? "" : "DIFFER");
+		ok = ok && same;
+	}
+	return ok;
+}
+
+int main(int argc, char **argv) {
+	int iterations = 1000;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:p:t")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'p':
+			host_lcd_dump(HostDump::PBM, optarg);
+			break;
+		case 't':
+			host_lcd_dump(HostDump::TEXT);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-n iterations] [-p pbm_prefix | -t]\n", argv[0]);
+			return 1;
+		}
+	}
+	display.begin();
+#if PCD8544_LAYER
+	grid();
+	display.captureBackground();
+#endif
+	bool packOk = packScenes();
+	printf("%-24s %12s %12s\n", "case", "us/call", "SPI bytes");
+	for (const Bench &b: benches) {
+		uint32_t bytes = host_lcd().cmdBytes + host_lcd().dataBytes;
+		uint64_t ns = 0;
+		for (int i=0; i<iterations; i++) {
+			uint32_t start = cycles();
+			b.fn();
+			ns += cycles() - start;
+		}
+		bytes = host_lcd().cmdBytes + host_lcd().dataBytes - bytes;
+		printf("%-24s %12.3f %12.1f\n", b.name, ns/1000.0/iterations, (double)bytes/iterations);
+	}
+	const AF_PCD8544_HAL::Stats &st = display.getStats();
+	printf("frames %u, SPI transfers %u, bytes %u\n", (unsigned)st.frames, (unsigned)st.transfers, (unsigned)st.bytes);
+	bool ok = textMatches();
+	printf("fast text vs drawChar: %s\n", ok ? "match" : "DIFFER");
+	ok = ok && packOk;
+	bool fillOk = fillMatches();
+	printf("fillRect vs pixels: %s\n", fillOk ? "match" : "DIFFER");
+	ok = ok && fillOk;
+	bool backendsOk = backendsMatch();
+	printf("LL vs HAL backend bus: %s\n", backendsOk ? "match" : "DIFFER");
+	ok = ok && backendsOk;
+	bool deferredOk = deferredMatches();
+	printf("commands with late DMA: %s\n", deferredOk ? "match" : "DIFFER");
+	ok = ok && deferredOk;
+	bool rectOk = rectMatches();
+	printf("displayRect vs display: %s\n", rectOk ? "match" : "DIFFER");
+	ok = ok && rectOk;
+	bool lifeOk = lifeMatches();
+	printf("life_step vs cell counting: %s\n", lifeOk ? "match" : "DIFFER");
+	ok = ok && lifeOk;
+	lifeRate(iterations);
+	bool windowsOk = windowDispatch(iterations);
+	printf("static vs virtual windows: %s\n", windowsOk ? "match" : "DIFFER");
+	ok = ok && windowsOk;
+	bool keysOk = keypadMatches();
+	printf("keypad vs reference debounce: %s\n", keysOk ? "match" : "DIFFER");
+	ok = ok && keysOk;
+	bool wheelOk = timerWheelMatches();
+	printf("timer wheel vs due ticks: %s\n", wheelOk ? "match" : "DIFFER");
+	ok = ok && wheelOk;
+	bool tasksOk = tasksMatch();
+	printf("task scheduler interleaving: %s\n", tasksOk ? "match" : "DIFFER");
+	ok = ok && tasksOk;
+	bool latencyOk = latencyMatches();
+	printf("latency stages vs virtual clock: %s\n", latencyOk ? "match" : "DIFFER");
+	ok = ok && latencyOk;
+	bool rtcOk = rtcMatches();
+	printf("rtc elapsed vs real time: %s\n", rtcOk ? "match" : "DIFFER");
+	ok = ok && rtcOk;
+	bool skipOk = skipMatches();
+	printf("skipped animation keys: %s\n", skipOk ? "match" : "DIFFER");
+	ok = ok && skipOk;
+	bool resumeOk = resumeMatches();
+	printf("resume renders once: %s\n", resumeOk ? "match" : "DIFFER");
+	ok = ok && resumeOk;
+	bool spscOk = spscStress();
+	printf("spsc queue stress: %s\n", spscOk ? "ok" : "FAILED");
+	ok = ok && spscOk;
+#if PCD8544_GRAY_PLANES
+	bool grayOk = grayMatches();
+	printf("gray planes vs levels: %s\n", grayOk ? "match" : "DIFFER");
+	ok = ok && grayOk;
+#endif
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,406 @@
+/**
+ * @file
+ * @brief Host implementation of the HAL stand-in and PCD8544 model
+ *
+ * SPI "DMA" completes right away, or ~0.1ms later from another thread
+ * with host_dma_defer(), and calls HAL_SPI_TxCpltCallback() just like
+ * the real DMA interrupt would. PCD8544_LL backend gets the same via the
+ * register mocks
+ * @author Denis Kokarev
+ */
+
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include "stm32f3xx_hal.h"
+#include "pcd8544_host.h"
+#include "spi.h"
+#include "rtc.h"
+
+GPIO_TypeDef host_gpioa;
+GPIO_TypeDef host_gpiob;
+SPI_TypeDef host_spi1;
+static DMA_Channel_TypeDef dma1Channel3;
+DMA_HandleTypeDef host_hdma_spi1_tx {&dma1Channel3, nullptr};
+
+/*
+ * must match the pins in program.cpp
+ */
+static const STM_HAL_Pin dc {GPIOB, GPIO_PIN_7};	///< data/command pin
+static const STM_HAL_Pin cs {GPIOB, GPIO_PIN_6};	///< chip select pin
+
+static PCD8544_Host lcd;
+static bool dirty;			///< got data since last CS release
+static HostDump dumpFmt = HostDump::NONE;
+static const char *dumpPrefix;
+static FILE *dumpOut;
+
+static const auto start = std::chrono::steady_clock::now();
+static std::atomic<bool> deferred;	///< DMA completes from another thread
+static std::vector<uint16_t> *busLog;	///< @see host_bus_record()
+
+static bool pin(const STM_HAL_Pin &p) {
+	return (p.base->ODR & p.pin) != 0;
+}
+
+/*** PCD8544 model ************************************/
+
+const PCD8544_Host &host_lcd() {
+	return lcd;
+}
+
+void host_lcd_dump(HostDump fmt, const char *prefix, FILE *out) {
+	dumpFmt = fmt;
+	dumpPrefix = prefix;
+	dumpOut = out;
+}
+
+bool host_lcd_pixel(int x, int y) {
+	bool on = (lcd.ram[x + (y/8)*LCDWIDTH] >> (y%8)) & 1;
+	switch (lcd.displayMode) {
+	case PCD8544_DISPLAYBLANK:
+		return false;
+	case PCD8544_DISPLAYALLON:
+		return true;
+	case PCD8544_DISPLAYINVERTED:
+		return !on;
+	default:
+		return on;
+	}
+}
+
+bool host_lcd_save_pbm(const char *fname) {
+	FILE *f = fopen(fname, "wb");
+	if (!f)
+		return false;
+	fprintf(f, "P4\n%d %d\n", LCDWIDTH, LCDHEIGHT);
+	for (int y=0; y<LCDHEIGHT; y++) {
+		uint8_t b = 0;
+		for (int x=0; x<LCDWIDTH; x++) {
+			b = (b << 1) | host_lcd_pixel(x, y);
+			if (x%8 == 7 || x == LCDWIDTH-1) {
+				fputc(b << (7 - x%8), f);
+				b = 0;
+			}
+		}
+	}
+	return fclose(f) == 0;
+}
+
+void host_lcd_print(FILE *out) {
+	for (int y=0; y<LCDHEIGHT; y++) {
+		for (int x=0; x<LCDWIDTH; x++)
+			fputc(host_lcd_pixel(x, y) ? '#' : '.', out);
+		fputc('\n', out);
+	}
+	fputc('\n', out);
+}
+
+static void frameDone() {
+	lcd.frames++;
+	switch (dumpFmt) {
+	case HostDump::PBM: {
+		char fname[256];
+		snprintf(fname, sizeof(fname), "%s%04u.pbm", dumpPrefix, (unsigned)lcd.frames);
+		host_lcd_save_pbm(fname);
+		break;
+	}
+	case HostDump::TEXT:
+		host_lcd_print(dumpOut);
+		break;
+	default:
+		break;
+	}
+}
+
+static void lcdCommand(uint8_t c) {
+	lcd.cmdBytes++;
+	lcd.cmdHash = lcd.cmdHash*31 + c;
+	if (c & 0x80) {
+		if (!lcd.extended)
+			lcd.x = (c & 0x7f) % LCDWIDTH;
+		// else Vop
+	} else if (c & 0x40) {
+		if (!lcd.extended)
+			lcd.y = (c & 0x07) % (LCDHEIGHT/8);
+	} else if (c & PCD8544_FUNCTIONSET) {
+		lcd.extended = (c & PCD8544_EXTENDEDINSTRUCTION) != 0;
+	} else if (c & PCD8544_DISPLAYCONTROL) {
+		if (!lcd.extended)
+			lcd.displayMode = c & (PCD8544_DISPLAYNORMAL | PCD8544_DISPLAYALLON);
+	}
+	// bias and temperature coefficient don't change the picture
+}
+
+static void lcdData(uint8_t d) {
+	lcd.dataBytes++;
+	lcd.ram[lcd.x + lcd.y*LCDWIDTH] = d;
+	if (++lcd.x == LCDWIDTH) {
+		lcd.x = 0;
+		lcd.y = (lcd.y + 1) % (LCDHEIGHT/8);
+	}
+	dirty = true;
+}
+
+void host_dma_defer(bool on) {
+	deferred = on;
+}
+
+void host_bus_record(std::vector<uint16_t> *log) {
+	busLog = log;
+}
+
+/*** Bus **********************************************/
+
+/**
+ * @brief drive the pins, CS going high ends the frame
+ */
+static void writePins(GPIO_TypeDef *port, uint16_t pins, bool high) {
+	bool csWasLow = !pin(cs);
+	if (high)
+		port->ODR |= pins;
+	else
+		port->ODR &= ~pins;
+	bool csLow = !pin(cs);
+	if (busLog && csLow != csWasLow)
+		busLog->push_back(HOST_BUS_CS | !csLow);
+	if (csWasLow && pin(cs) && dirty) {
+		dirty = false;
+		frameDone();
+	}
+}
+
+/**
+ * @brief shift the bytes out to the controller
+ */
+static void spiBytes(const uint8_t *p, uint16_t sz) {
+	if (pin(cs))
+		return; // nobody listens
+	for (uint16_t i=0; i<sz; i++) {
+		if (busLog)
+			busLog->push_back((pin(dc) ? HOST_BUS_DC : 0) | p[i]);
+		if (pin(dc))
+			lcdData(p[i]);
+		else
+			lcdCommand(p[i]);
+	}
+}
+
+/**
+ * @brief complete the transfer right away or from another thread, @see host_dma_defer()
+ */
+template<typename F>
+static void dmaTransfer(F transfer) {
+	if (deferred) {
+		std::thread([transfer]() {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			transfer();
+		}).detach();
+	} else {
+		transfer();
+	}
+}
+
+/**
+ * @brief DMA1 channel 3 feeds SPI1 once the both are enabled
+ */
+static void spiDma() {
+	DMA_Channel_TypeDef &ch = dma1Channel3;
+	if (!(ch.CCR & DMA_CCR_EN) || !(host_spi1.CR2 & SPI_CR2_TXDMAEN) || !(host_spi1.CR1 & SPI_CR1_SPE) || ch.CNDTR == 0)
+		return;
+	const uint8_t *p = reinterpret_cast<const uint8_t*>(uintptr_t(ch.CMAR));
+	uint16_t sz = ch.CNDTR;
+	ch.CNDTR.value = 0;
+	dmaTransfer([p, sz]() {
+		spiBytes(p, sz);
+		if ((dma1Channel3.CCR & DMA_CCR_TCIE) && host_hdma_spi1_tx.XferCpltCallback)
+			host_hdma_spi1_tx.XferCpltCallback(&host_hdma_spi1_tx);
+	});
+}
+
+void host_reg_write(HostReg *r) {
+	for (GPIO_TypeDef *port: {GPIOA, GPIOB}) {
+		if (r == &port->BSRR) {
+			writePins(port, r->value & 0xffff, true);
+			writePins(port, r->value >> 16, false);
+		} else if (r == &port->BRR) {
+			writePins(port, r->value, false);
+		}
+	}
+	if (r == &host_spi1.CR1 || r == &host_spi1.CR2 || r == &dma1Channel3.CCR)
+		spiDma();
+}
+
+/*** HAL **********************************************/
+
+extern "C" {
+
+	void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+		writePins(GPIOx, GPIO_Pin, PinState == GPIO_PIN_SET);
+	}
+
+	GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+		return (GPIOx->ODR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+	}
+
+	HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout) {
+		spiBytes(pData, Size);
+		return HAL_OK;
+	}
+
+	HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size) {
+		if (deferred)
+			hspi->State = HAL_SPI_STATE_BUSY_TX;
+		dmaTransfer([hspi, pData, Size]() {
+			spiBytes(pData, Size);
+			hspi->State = HAL_SPI_STATE_READY;
+			HAL_SPI_TxCpltCallback(hspi);
+		});
+		return HAL_OK;
+	}
+
+	HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi) {
+		return HAL_SPI_STATE_READY;
+	}
+
+	uint32_t HAL_GetTick(void) {
+		auto real = std::chrono::steady_clock::now() - start;
+		return std::chrono::duration_cast<std::chrono::milliseconds>(real).count() + uwTick;
+	}
+
+	void HAL_Delay(uint32_t Delay) {
+		uwTick += Delay;
+	}
+
+}
+
+/*** MCU model ****************************************/
+
+volatile uint32_t uwTick;
+SysTick_Type host_systick;
+SCB_Type host_scb;
+EXTI_TypeDef host_exti;
+// as SystemClock_Config() leaves them, 72MHz off the PLL
+FLASH_TypeDef host_flash {FLASH_LATENCY_2};
+RCC_TypeDef host_rcc {RCC_CR_HSEON | RCC_CR_PLLON,
+	RCC_SYSCLKSOURCE_PLLCLK | RCC_HCLK_DIV4 | (RCC_HCLK_DIV4 << 3) | RCC_PLLSOURCE_HSE | RCC_PLL_MUL9, RCC_HSE_PREDIV_DIV1};
+uint32_t SystemCoreClock = 72000000;
+// CubeMX prescalers for the 40kHz LSI
+RTC_TypeDef host_rtc {0, 0, 0, 0, (127 << 16) | 255, 0, 0, 0};
+
+SPI_HandleTypeDef hspi1 {SPI1, &host_hdma_spi1_tx, HAL_SPI_STATE_READY, {SPI_BAUDRATEPRESCALER_4}};
+RTC_HandleTypeDef hrtc {RTC};
+
+static bool irqOff;			///< PRIMASK
+static bool tickSuspended;	///< HAL_SuspendTick()
+static bool wakeupPending;	///< the RTC interrupt waits for __enable_irq()
+
+static void rtcIrq() {
+	wakeupPending = false;
+	HAL_RTCEx_WakeUpTimerEventCallback(&hrtc);
+	host_rtc.ISR &= ~RTC_ISR_WUTF;
+}
+
+/**
+ * @brief wait for an interrupt, the SysTick one a ms later or else the RTC wakeup
+ *
+ * Without the tick the HAL tick stands still, the caller makes up for the sleep
+ */
+static void wfi() {
+	if (!tickSuspended) {
+		uwTick++;
+		if (!irqOff)
+			HAL_SYSTICK_Callback();
+		return;
+	}
+	if (!(host_rtc.CR & RTC_CR_WUTE)) {
+		fprintf(stderr, "WFI with nothing to wake up\n");
+		abort();
+	}
+	host_rtc.ISR |= RTC_ISR_WUTF;
+	wakeupPending = true;
+	if (!irqOff)
+		rtcIrq();
+}
+
+extern "C" {
+
+	void Error_Handler(void) {
+		fprintf(stderr, "Error_Handler\n");
+		abort();
+	}
+
+	void HAL_SuspendTick(void) {
+		tickSuspended = true;
+	}
+
+	void HAL_ResumeTick(void) {
+		tickSuspended = false;
+	}
+
+	void __disable_irq(void) {
+		irqOff = true;
+	}
+
+	void __enable_irq(void) {
+		irqOff = false;
+		if (wakeupPending)
+			rtcIrq();
+	}
+
+	uint32_t __get_PRIMASK(void) {
+		return irqOff;
+	}
+
+	void __set_PRIMASK(uint32_t priMask) {
+		if (priMask)
+			__disable_irq();
+		else
+			__enable_irq();
+	}
+
+	uint32_t HAL_SYSTICK_Config(uint32_t TicksNumb) {
+		host_systick.LOAD = TicksNumb - 1;
+		return 0;
+	}
+
+	void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority) {
+	}
+
+	void SystemCoreClockUpdate(void) {
+		uint32_t sws = (host_rcc.CFGR & RCC_CFGR_SWS) >> RCC_CFGR_SWS_Pos;
+		if (sws == RCC_SYSCLKSOURCE_PLLCLK) {
+			uint32_t mul = ((host_rcc.CFGR & RCC_CFGR_PLLMUL) >> 18) + 2;
+			SystemCoreClock = HSE_VALUE/((host_rcc.CFGR2 & RCC_CFGR2_PREDIV) + 1)*mul;
+		} else {
+			SystemCoreClock = (sws == RCC_SYSCLKSOURCE_HSE) ? HSE_VALUE : HSI_VALUE;
+		}
+	}
+
+	void HAL_PWR_EnterSLEEPMode(uint32_t Regulator, uint8_t SLEEPEntry) {
+		wfi();
+	}
+
+	void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry) {
+		wfi();
+		host_rcc.CR &= ~(RCC_CR_HSEON | RCC_CR_PLLON);
+		host_rcc.CFGR &= ~RCC_CFGR_SW;
+		SystemCoreClockUpdate();
+	}
+
+	HAL_StatusTypeDef HAL_RTCEx_SetWakeUpTimer_IT(RTC_HandleTypeDef *hrtc, uint32_t WakeUpCounter, uint32_t WakeUpClock) {
+		hrtc->Instance->WUTR = WakeUpCounter;
+		hrtc->Instance->ISR &= ~RTC_ISR_WUTF;
+		hrtc->Instance->CR |= RTC_CR_WUTE;
+		return HAL_OK;
+	}
+
+	HAL_StatusTypeDef HAL_RTC_WaitForSynchro(RTC_HandleTypeDef *hrtc) {
+		return HAL_OK;
+	}
+
+}
@@ -0,0 +1,28 @@
+/**
+ * @file
+ * @brief The LCD driver on its register level backend next to the HAL one
+ *
+ * AF_PCD8544_HAL.cpp is built here once more with PCD8544_LL and the class
+ * renamed to AF_PCD8544_LL, so vgame-host links both backends and drives
+ * the register mocks of the host HAL stand-in
+ * @author Denis Kokarev
+ */
+
+#define PCD8544_LL
+#define AF_PCD8544_HAL AF_PCD8544_LL
+#include "AF_PCD8544_HAL.cpp"
+#include "backend.h"
+
+/*
+ * the pins must match program.cpp, SPI1 TX DMA is what CubeMX sets up
+ */
+static SPI_HandleTypeDef hspi1 {SPI1, &host_hdma_spi1_tx, HAL_SPI_STATE_READY};
+static const STM_HAL_Pin dc {GPIOB, GPIO_PIN_7};
+static const STM_HAL_Pin cs {GPIOB, GPIO_PIN_6};
+static const STM_HAL_Pin rst {GPIOA, GPIO_PIN_15};
+
+static AF_PCD8544_LL display(hspi1, dc, cs, rst);
+
+void host_ll_scenario() {
+	backendScenario(display);
+}
@@ -0,0 +1,59 @@
+/**
+ * @file
+ * @brief Packer of 1bpp images for the firmware unpack()
+ * @author Denis Kokarev
+ */
+
+#include "pack.h"
+#include "unpack.h"
+
+/// move the pending literal bytes into the stream
+static void literals(std::vector<uint8_t> &out, const uint8_t *from, int n) {
+	while (n > 0) {
+		int k = (n < PACK_MAX_LITERAL) ? n : PACK_MAX_LITERAL;
+		out.push_back(PACK_LITERAL | (k - 1));
+		out.insert(out.end(), from, from + k);
+		from += k;
+		n -= k;
+	}
+}
+
+std::vector<uint8_t> pack(const uint8_t *img, uint8_t w, uint8_t banks) {
+	std::vector<uint8_t> out {w, banks};
+	int size = w*banks;
+	int lit = 0;	// where pending literals start
+	for (int i=0; i<size;) {
+		int limit = (size - i < PACK_MAX_MATCH) ? size - i : PACK_MAX_MATCH;
+		int run = 1;
+		while (run < limit && img[i+run] == img[i])
+			run++;
+		int copy = 0;
+		int off = 0;
+		for (int j=(i > PACK_WINDOW) ? i-PACK_WINDOW : 0; j<i; j++) {
+			int k = 0;
+			while (k < limit && img[j+k] == img[i+k])
+				k++;
+			if (k > copy) {
+				copy = k;
+				off = i - j;
+			}
+		}
+		if (run >= PACK_MIN_MATCH && run >= copy) {
+			literals(out, img + lit, i - lit);
+			out.push_back(PACK_RUN | (run - PACK_MIN_MATCH));
+			out.push_back(img[i]);
+			i += run;
+			lit = i;
+		} else if (copy >= PACK_MIN_MATCH) {
+			literals(out, img + lit, i - lit);
+			out.push_back(PACK_COPY | (copy - PACK_MIN_MATCH));
+			out.push_back(off - 1);
+			i += copy;
+			lit = i;
+		} else {
+			i++;
+		}
+	}
+	literals(out, img + lit, size - lit);
+	return out;
+}
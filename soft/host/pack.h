@@ -0,0 +1,24 @@
+/**
+ * @file
+ * @brief Packer of 1bpp images for the firmware unpack()
+ * @see unpack.h for the format
+ * @author Denis Kokarev
+ */
+#ifndef _PACK_H
+#define _PACK_H
+
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief pack the image
+ *
+ * Greedy choice of the longest run or copy at every byte
+ * @param img - column bytes, bank after bank without gaps
+ * @param w - width in columns
+ * @param banks - height in 8 pixel banks
+ * @return the packed stream with its header
+ */
+std::vector<uint8_t> pack(const uint8_t *img, uint8_t w, uint8_t banks);
+
+#endif
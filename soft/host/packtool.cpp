@@ -0,0 +1,114 @@
+/**
+ * @file
+ * @brief Asset packer for the firmware
+ *
+ * Converts PBM image (P1 or P4) into a C array of unpack() format,
+ * ready to be drawn with AF_PCD8544_HAL::drawPacked(). The height is
+ * padded with white pixels to the multiple of 8
+ *
+ * usage: vgame-pack [-n name] image.pbm > image.h
+ * @author Denis Kokarev
+ */
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include "pack.h"
+
+/// next PBM header number, skipping whitespace and comments
+static int pbmNumber(FILE *f) {
+	int c;
+	while ((c = fgetc(f)) != EOF) {
+		if (c == '#') {
+			while ((c = fgetc(f)) != EOF && c != '\n') {
+			}
+		} else if (!isspace(c)) {
+			break;
+		}
+	}
+	int n = 0;
+	while (c != EOF && isdigit(c)) {
+		n = n*10 + c - '0';
+		c = fgetc(f);
+	}
+	return n;
+}
+
+/**
+ * @brief read PBM into bank layout
+ * @return false on unsupported or broken file
+ */
+static bool readPbm(FILE *f, std::vector<uint8_t> &img, int &w, int &banks) {
+	char magic[2];
+	if (fread(magic, 1, 2, f) != 2 || magic[0] != 'P' || (magic[1] != '1' && magic[1] != '4'))
+		return false;
+	w = pbmNumber(f);
+	int h = pbmNumber(f);
+	if (w <= 0 || w > 255 || h <= 0 || h > 255*8)
+		return false;
+	banks = (h + 7) / 8;
+	img.assign(w*banks, 0);
+	for (int y=0; y<h; y++) {
+		int byte = 0;
+		for (int x=0; x<w; x++) {
+			int bit;
+			if (magic[1] == '4') {
+				if (x%8 == 0 && (byte = fgetc(f)) == EOF)
+					return false;
+				bit = (byte >> (7 - x%8)) & 1;
+			} else {
+				int c;
+				while ((c = fgetc(f)) != EOF && isspace(c)) {
+				}
+				if (c != '0' && c != '1')
+					return false;
+				bit = c - '0';
+			}
+			if (bit)
+				img[x + (y/8)*w] |= 1 << (y%8);
+		}
+	}
+	return true;
+}
+
+int main(int argc, char **argv) {
+	const char *name = "image";
+	int opt;
+	while ((opt = getopt(argc, argv, "n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			name = optarg;
+			break;
+		default:
+			optind = argc;
+			break;
+		}
+	}
+	if (optind != argc-1) {
+		fprintf(stderr, "usage: %s [-n name] image.pbm > image.h\n", argv[0]);
+		return 1;
+	}
+	FILE *f = fopen(argv[optind], "rb");
+	if (!f) {
+		perror(argv[optind]);
+		return 1;
+	}
+	std::vector<uint8_t> img;
+	int w, banks;
+	bool ok = readPbm(f, img, w, banks);
+	fclose(f);
+	if (!ok) {
+		fprintf(stderr, "%s: not a PBM image up to 255 columns\n", argv[optind]);
+		return 1;
+	}
+	std::vector<uint8_t> packed = pack(img.data(), w, banks);
+	printf("/* %s: %dx%d, %u bytes packed into %u */\n", argv[optind], w, banks*8, (unsigned)img.size(), (unsigned)packed.size());
+	printf("static const uint8_t %s[] = {", name);
+	for (size_t i=0; i<packed.size(); i++)
+		printf("%s0x%02x,", (i%12) ? " " : "\n\t", packed[i]);
+	printf("\n};\n");
+	fprintf(stderr, "%s: %u -> %u bytes, %.1f%%\n", argv[optind], (unsigned)img.size(), (unsigned)packed.size(), 100.0*packed.size()/img.size());
+	return 0;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file
+ * @brief PCD8544 controller model for the host build
+ *
+ * Interprets the bytes AF_PCD8544_HAL sends over SPI the same way
+ * the real controller does, so the host picture is exactly what the
+ * LCD would show. Every completed frame may be dumped into a file
+ * @author Denis Kokarev
+ */
+#ifndef _PCD8544_HOST_H
+#define _PCD8544_HOST_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+#include "AF_PCD8544_HAL.h"
+
+/**
+ * @brief What the controller has received so far
+ */
+struct PCD8544_Host {
+	uint8_t ram[LCDWIDTH * LCDHEIGHT / 8];	///< display data RAM
+	uint8_t x;				///< X address
+	uint8_t y;				///< Y (bank) address
+	bool extended;			///< H bit of function set
+	uint8_t displayMode;	///< last PCD8544_DISPLAY* mode
+	uint32_t cmdBytes;		///< command bytes received
+	uint32_t cmdHash;		///< of the command bytes in the order received
+	uint32_t dataBytes;		///< data bytes received
+	uint32_t frames;		///< CS releases after some data
+};
+
+/**
+ * @brief Formats to dump the frames
+ */
+enum class HostDump {
+	NONE,	///< keep frames to yourself
+	PBM,	///< one binary PBM file per frame
+	TEXT	///< ASCII art into a single stream
+};
+
+/**
+ * @brief the controller state
+ */
+const PCD8544_Host &host_lcd();
+
+/**
+ * @brief dump every frame from now on
+ * @param fmt - what format
+ * @param prefix - PBM file name prefix, the frame number and .pbm get appended
+ * @param out - the stream for TEXT format
+ */
+void host_lcd_dump(HostDump fmt, const char *prefix = "frame", FILE *out = stdout);
+
+/**
+ * @brief write what the LCD shows now as PBM file
+ * @return false on I/O error
+ */
+bool host_lcd_save_pbm(const char *fname);
+
+/**
+ * @brief write what the LCD shows now as ASCII art
+ */
+void host_lcd_print(FILE *out);
+
+/**
+ * @brief complete SPI DMA transfers later from another thread, like the real DMA does
+ *
+ * The bytes are taken at completion, so a buffer overwritten in flight shows up.
+ * By default the transfers complete right away
+ */
+void host_dma_defer(bool on);
+
+constexpr uint16_t HOST_BUS_DC = 0x100;	///< host_bus_record() entry of a byte sent with DC high, i.e. data
+constexpr uint16_t HOST_BUS_CS = 0x200;	///< host_bus_record() entry of CS changed to the level in bit 0
+
+/**
+ * @brief log what goes over the LCD bus from now on, nullptr to stop
+ *
+ * The bytes with their DC level and CS changes, to compare the LCD driver backends
+ */
+void host_bus_record(std::vector<uint16_t> *log);
+
+/**
+ * @brief is the pixel dark on the LCD now, taking the display mode into account
+ */
+bool host_lcd_pixel(int x, int y);
+
+#endif
@@ -0,0 +1,303 @@
+/**
+ * @file
+ * @brief Host stand-in for STM32 HAL
+ *
+ * Just enough of STM32 HAL for the display code to build and run on a PC.
+ * The SPI transfers are fed into PCD8544 controller model, @see pcd8544_host.h
+ * The registers PCD8544_LL backend writes are mocks acting like the hardware:
+ * GPIO BSRR/BRR move the pins and enabling SPI1 TX DMA on DMA1 channel 3
+ * sends the bytes and calls the channel handle's XferCpltCallback.
+ * The rest of the MCU is modelled for program.cpp: the time is virtual, WFI
+ * steps it by a SysTick ms or, with the tick suspended, ends on the RTC wakeup
+ * @author Denis Kokarev
+ */
+#ifndef _HOST_STM32F3XX_HAL_H
+#define _HOST_STM32F3XX_HAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct HostReg;
+/** @brief the hardware reacting to a register write */
+void host_reg_write(HostReg *r);
+
+/**
+ * @brief mock register, wide enough to hold a host pointer for the DMA address registers
+ */
+struct HostReg {
+	volatile uintptr_t value;	///< the register content
+	HostReg &operator=(uintptr_t v) {
+		value = v;
+		host_reg_write(this);
+		return *this;
+	}
+	HostReg &operator|=(uintptr_t v) {
+		return *this = value | v;
+	}
+	HostReg &operator&=(uintptr_t v) {
+		return *this = value & v;
+	}
+	operator uintptr_t() const {
+		return value;
+	}
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define __IO volatile
+
+typedef enum {
+	HAL_OK = 0,
+	HAL_ERROR,
+	HAL_BUSY,
+	HAL_TIMEOUT
+} HAL_StatusTypeDef;
+
+typedef enum {
+	GPIO_PIN_RESET = 0,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+/** @brief GPIO port is just its output state and the registers to change it */
+typedef struct {
+	uint32_t ODR;
+	HostReg BSRR;	///< low half sets the pins, high half resets them
+	HostReg BRR;	///< resets the pins
+	volatile uint32_t IDR;	///< input pins, the buttons are released
+} GPIO_TypeDef;
+
+extern GPIO_TypeDef host_gpioa;
+extern GPIO_TypeDef host_gpiob;
+#define GPIOA (&host_gpioa)
+#define GPIOB (&host_gpiob)
+
+#define GPIO_PIN_0	((uint16_t)0x0001)
+#define GPIO_PIN_1	((uint16_t)0x0002)
+#define GPIO_PIN_2	((uint16_t)0x0004)
+#define GPIO_PIN_3	((uint16_t)0x0008)
+#define GPIO_PIN_4	((uint16_t)0x0010)
+#define GPIO_PIN_5	((uint16_t)0x0020)
+#define GPIO_PIN_6	((uint16_t)0x0040)
+#define GPIO_PIN_7	((uint16_t)0x0080)
+#define GPIO_PIN_15	((uint16_t)0x8000)
+
+typedef enum {
+	HAL_SPI_STATE_RESET = 0,
+	HAL_SPI_STATE_READY,
+	HAL_SPI_STATE_BUSY_TX
+} HAL_SPI_StateTypeDef;
+
+/** @brief SPI registers, SR reads empty FIFOs and not busy */
+typedef struct {
+	HostReg CR1, CR2, SR, DR;
+} SPI_TypeDef;
+
+#define SPI_CR1_SPE		0x0040U
+#define SPI_CR1_BR		0x0038U
+#define SPI_CR2_TXDMAEN	0x0002U
+#define SPI_SR_BSY		0x0080U
+#define SPI_SR_FTLVL	0x1800U
+
+/** @brief DMA channel registers */
+typedef struct {
+	HostReg CCR, CNDTR, CPAR, CMAR;
+} DMA_Channel_TypeDef;
+
+#define DMA_CCR_EN		0x0001U
+#define DMA_CCR_TCIE	0x0002U
+
+/** @brief DMA channel handle, only what the completion interrupt calls */
+typedef struct __DMA_HandleTypeDef {
+	DMA_Channel_TypeDef *Instance;
+	void (*XferCpltCallback)(struct __DMA_HandleTypeDef *hdma);
+} DMA_HandleTypeDef;
+
+extern SPI_TypeDef host_spi1;
+extern DMA_HandleTypeDef host_hdma_spi1_tx;	///< SPI1 TX on DMA1 channel 3
+#define SPI1 (&host_spi1)
+
+#define SPI_BAUDRATEPRESCALER_2	0x0000U
+#define SPI_BAUDRATEPRESCALER_4	0x0008U
+
+/** @brief SPI settings, only the one the clock profiles change */
+typedef struct {
+	uint32_t BaudRatePrescaler;
+} SPI_InitTypeDef;
+
+/** @brief SPI device transfers complete instantly on host, unless host_dma_defer() */
+typedef struct __SPI_HandleTypeDef {
+	SPI_TypeDef *Instance;
+	DMA_HandleTypeDef *hdmatx;
+	__IO HAL_SPI_StateTypeDef State;
+	SPI_InitTypeDef Init;
+} SPI_HandleTypeDef;
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+HAL_StatusTypeDef HAL_SPI_Transmit(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size, uint32_t Timeout);
+HAL_StatusTypeDef HAL_SPI_Transmit_DMA(SPI_HandleTypeDef *hspi, uint8_t *pData, uint16_t Size);
+HAL_SPI_StateTypeDef HAL_SPI_GetState(SPI_HandleTypeDef *hspi);
+void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi);
+
+/** @brief milliseconds since start plus uwTick, HAL_Delay() and WFI advance it without sleeping */
+uint32_t HAL_GetTick(void);
+void HAL_Delay(uint32_t Delay);
+extern volatile uint32_t uwTick;	///< the virtual ms
+void HAL_SuspendTick(void);
+void HAL_ResumeTick(void);
+
+/*** MCU model ****************************************/
+
+typedef enum {
+	RESET = 0,
+	SET = !RESET
+} FlagStatus;
+
+typedef enum {
+	SysTick_IRQn = -1
+} IRQn_Type;
+
+#define SET_BIT(REG, BIT)	((REG) |= (BIT))
+#define CLEAR_BIT(REG, BIT)	((REG) &= ~(BIT))
+
+/** @brief PRIMASK, the interrupts which came meanwhile run on __enable_irq() */
+void __disable_irq(void);
+void __enable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t priMask);
+
+/** @brief SysTick counts nothing within a ms on host */
+typedef struct {
+	volatile uint32_t CTRL, LOAD, VAL;
+} SysTick_Type;
+
+typedef struct {
+	volatile uint32_t ICSR;
+} SCB_Type;
+
+#define SCB_ICSR_PENDSTSET_Msk	(1UL << 26)
+
+extern SysTick_Type host_systick;
+extern SCB_Type host_scb;
+#define SysTick (&host_systick)
+#define SCB (&host_scb)
+
+uint32_t HAL_SYSTICK_Config(uint32_t TicksNumb);
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+void HAL_SYSTICK_Callback(void);
+
+/** @brief EXTI lines, no edges come on host */
+typedef struct {
+	volatile uint32_t IMR, EMR, RTSR, FTSR, SWIER, PR;
+} EXTI_TypeDef;
+
+extern EXTI_TypeDef host_exti;
+#define EXTI (&host_exti)
+#define __HAL_GPIO_EXTI_CLEAR_IT(__EXTI_LINE__)	(EXTI->PR = (__EXTI_LINE__))
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+
+typedef struct {
+	volatile uint32_t ACR;
+} FLASH_TypeDef;
+
+extern FLASH_TypeDef host_flash;
+#define FLASH (&host_flash)
+
+#define FLASH_ACR_LATENCY	0x0007U
+#define FLASH_LATENCY_0		0x0000U
+#define FLASH_LATENCY_1		0x0001U
+#define FLASH_LATENCY_2		0x0002U
+
+/**
+ * @brief RCC clock control, the oscillators and the PLL are ready
+ * as soon as they're on and the clock switches at once
+ */
+typedef struct {
+	volatile uint32_t CR, CFGR, CFGR2;
+} RCC_TypeDef;
+
+extern RCC_TypeDef host_rcc;
+#define RCC (&host_rcc)
+
+#define RCC_CR_HSEON		0x00010000U
+#define RCC_CR_HSERDY		RCC_CR_HSEON
+#define RCC_CR_PLLON		0x01000000U
+#define RCC_CR_PLLRDY		RCC_CR_PLLON
+#define RCC_CFGR_SW			0x00000003U
+#define RCC_CFGR_SWS		RCC_CFGR_SW
+#define RCC_CFGR_SWS_Pos	0U
+#define RCC_CFGR_PPRE1		0x00000700U
+#define RCC_CFGR_PPRE2		0x00003800U
+#define RCC_CFGR_PLLSRC		0x00010000U
+#define RCC_CFGR_PLLMUL		0x003C0000U
+#define RCC_CFGR2_PREDIV	0x0000000FU
+
+#define RCC_HCLK_DIV1			0x00000000U
+#define RCC_HCLK_DIV2			0x00000400U
+#define RCC_HCLK_DIV4			0x00000500U
+#define RCC_HSE_PREDIV_DIV1		0x00000000U
+#define RCC_HSE_PREDIV_DIV2		0x00000001U
+#define RCC_PLL_OFF				0x00000001U
+#define RCC_PLL_ON				0x00000002U
+#define RCC_PLLSOURCE_HSE		RCC_CFGR_PLLSRC
+#define RCC_PLL_MUL9			0x001C0000U
+#define RCC_SYSCLKSOURCE_HSE	0x00000001U
+#define RCC_SYSCLKSOURCE_PLLCLK	0x00000002U
+
+#define __HAL_RCC_HSE_PREDIV_CONFIG(__HSE_PREDIV_VALUE__) \
+	(RCC->CFGR2 = (RCC->CFGR2 & ~RCC_CFGR2_PREDIV) | (__HSE_PREDIV_VALUE__))
+#define __HAL_RCC_PLL_CONFIG(__RCC_PLLSOURCE__, __PLLMUL__) \
+	(RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_PLLMUL | RCC_CFGR_PLLSRC)) | (__PLLMUL__) | (__RCC_PLLSOURCE__))
+
+#define HSE_VALUE	8000000U
+#define HSI_VALUE	8000000U
+#define LSI_VALUE	40000U
+
+/** @brief HCLK by the RCC registers */
+extern uint32_t SystemCoreClock;
+void SystemCoreClockUpdate(void);
+
+#define PWR_MAINREGULATOR_ON		0x00000000U
+#define PWR_LOWPOWERREGULATOR_ON	0x00000001U
+#define PWR_SLEEPENTRY_WFI			((uint8_t)0x01)
+#define PWR_STOPENTRY_WFI			((uint8_t)0x01)
+
+/** @brief WFI, STOP mode leaves the HSI running the system */
+void HAL_PWR_EnterSLEEPMode(uint32_t Regulator, uint8_t SLEEPEntry);
+void HAL_PWR_EnterSTOPMode(uint32_t Regulator, uint8_t STOPEntry);
+
+/** @brief RTC, the calendar stands still and the wakeup timer fires on the next WFI */
+typedef struct {
+	volatile uint32_t TR, DR, CR, ISR, PRER, WUTR, WPR, SSR;
+} RTC_TypeDef;
+
+typedef struct {
+	RTC_TypeDef *Instance;
+} RTC_HandleTypeDef;
+
+extern RTC_TypeDef host_rtc;
+#define RTC (&host_rtc)
+
+#define RTC_CR_WUTE		0x00000400U
+#define RTC_ISR_WUTF	0x00000400U
+#define RTC_FLAG_WUTF	RTC_ISR_WUTF
+#define RTC_WAKEUPCLOCK_RTCCLK_DIV16	0x00000000U
+
+#define __HAL_RTC_WRITEPROTECTION_DISABLE(__HANDLE__) \
+	do { (__HANDLE__)->Instance->WPR = 0xCAU; (__HANDLE__)->Instance->WPR = 0x53U; } while (0)
+#define __HAL_RTC_WRITEPROTECTION_ENABLE(__HANDLE__)	((__HANDLE__)->Instance->WPR = 0xFFU)
+#define __HAL_RTC_WAKEUPTIMER_DISABLE(__HANDLE__)	((__HANDLE__)->Instance->CR &= ~RTC_CR_WUTE)
+#define __HAL_RTC_WAKEUPTIMER_GET_FLAG(__HANDLE__, __FLAG__) \
+	((((__HANDLE__)->Instance->ISR & (__FLAG__)) != RESET) ? SET : RESET)
+
+HAL_StatusTypeDef HAL_RTCEx_SetWakeUpTimer_IT(RTC_HandleTypeDef *hrtc, uint32_t WakeUpCounter, uint32_t WakeUpClock);
+HAL_StatusTypeDef HAL_RTC_WaitForSynchro(RTC_HandleTypeDef *hrtc);
+void HAL_RTCEx_WakeUpTimerEventCallback(RTC_HandleTypeDef *hrtc);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
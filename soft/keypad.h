@@ -0,0 +1,117 @@
+/**
+ * @file
+ * @brief Debouncing and auto-repeat of up to 8 buttons
+ *
+ * Fed with the button levels once a ms. A level is accepted after it
+ * holds for STABLE_SAMPLES samples in a row, counted by 2 bit vertical
+ * counters - one bitwise pass handles all the buttons at once
+ * @author Denis Kokarev
+ */
+#ifndef _KEYPAD_H
+#define _KEYPAD_H
+
+#include <cstdint>
+
+/**
+ * @brief debouncer and auto-repeat state machine
+ *
+ * Pure logic with no hardware dependencies, the caller does the sampling
+ */
+class Keypad {
+public:
+	/**
+	 * @brief what happened to the key
+	 */
+	enum Action {
+		PRESS,		///< accepted press
+		RELEASE,	///< accepted release
+		REPEAT		///< still held, auto-repeat
+	};
+	/// samples a new level must hold to be accepted, fixed by the 2 bit counters
+	static constexpr uint8_t STABLE_SAMPLES = 4;
+	/**
+	 * @param repeat - mask of the keys to auto-repeat
+	 * @param delay - samples from the press to the first repeat
+	 * @param period - samples between the repeats
+	 */
+	Keypad(uint8_t repeat = 0, uint16_t delay = 400, uint16_t period = 100):
+		state(0), ct0(0xff), ct1(0xff), repeatMask(repeat), repeatDelay(delay), repeatPeriod(period),
+		repeatKey(-1), repeats(0), held(0) {
+	}
+	/**
+	 * @brief which keys repeat while held and how fast
+	 * @param mask - the keys, 0 for none
+	 * @param delay - samples from the press to the first repeat
+	 * @param period - samples between the repeats
+	 */
+	void setRepeat(uint8_t mask, uint16_t delay, uint16_t period) {
+		repeatMask = mask;
+		repeatDelay = delay;
+		repeatPeriod = period;
+		repeatKey = -1;
+	}
+	/**
+	 * @brief the accepted levels, bit set - pressed
+	 */
+	uint8_t pressed() const {
+		return state;
+	}
+	/**
+	 * @brief all released and no change pending, the sampling may stop
+	 */
+	bool settled() const {
+		return state == 0 && (ct0 & ct1) == 0xff;
+	}
+	/**
+	 * @brief take one sample
+	 *
+	 * Only the most recently pressed repeating key repeats
+	 * @param levels - bit set - pressed now
+	 * @param emit - invoked as emit(uint8_t key, Action a, uint8_t n) for every event,
+	 * key is the bit number, n is the repeat count saturating at 255, 0 for the others
+	 */
+	template<typename F>
+	void sample(uint8_t levels, F emit) {
+		// the key pressed by the previous samples
+		if (repeatKey >= 0 && ++held >= (repeats ? repeatPeriod : repeatDelay)) {
+			held = 0;
+			if (repeats < 255)
+				repeats++;
+			emit(uint8_t(repeatKey), REPEAT, repeats);
+		}
+		uint8_t delta = levels ^ state;
+		// count down while the level differs, back to 3 when it doesn't
+		ct0 = ~(ct0 & delta);
+		ct1 = ct0 ^ (ct1 & delta);
+		uint8_t toggle = delta & ct0 & ct1;
+		state ^= toggle;
+		for (uint8_t k=0; toggle; k++, toggle >>= 1) {
+			if (!(toggle & 1))
+				continue;
+			if (state & (1 << k)) {
+				emit(k, PRESS, 0);
+				if (repeatMask & (1 << k)) {
+					repeatKey = k;
+					repeats = 0;
+					held = 0;
+				}
+			} else {
+				emit(k, RELEASE, 0);
+				if (repeatKey == k)
+					repeatKey = -1;
+			}
+		}
+	}
+protected:
+	uint8_t state;			///< accepted levels
+	uint8_t ct0;			///< vertical counter bit 0
+	uint8_t ct1;			///< vertical counter bit 1
+	uint8_t repeatMask;		///< keys to auto-repeat
+	uint16_t repeatDelay;	///< samples to the first repeat
+	uint16_t repeatPeriod;	///< samples between the repeats
+	int8_t repeatKey;		///< the repeating key, -1 for none
+	uint8_t repeats;		///< repeats so far
+	uint16_t held;			///< samples since the press or the last repeat
+};
+
+#endif
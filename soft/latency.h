@@ -0,0 +1,132 @@
+/**
+ * @file
+ * @brief Input-to-photon latency of the key presses
+ *
+ * LatencyTrace follows one press at a time from the button interrupt
+ * through the event queue, handleEvent() and render to the end of the
+ * frame's SPI transfer, and adds up every stage into a histogram.
+ * Pure logic, the caller passes the time in microseconds
+ * @author Denis Kokarev
+ */
+#ifndef _LATENCY_H
+#define _LATENCY_H
+
+#include <cstdint>
+
+/**
+ * @brief press-to-screen latency histograms
+ */
+class LatencyTrace {
+public:
+	/**
+	 * @brief where the time goes, they add up to TOTAL
+	 */
+	enum Stage: uint8_t {
+		QUEUE = 0,	///< interrupt to the event taken from the queue, the debounce included
+		HANDLE,		///< handleEvent()
+		RENDER,		///< handled to the frame started
+		SPI,		///< the frame transfer
+		TOTAL,		///< interrupt to the frame on the screen
+		STAGES
+	};
+	static constexpr int BUCKETS = 16;	///< bucket b counts [2^b, 2^(b+1)) us, the last one 32ms and more
+	/**
+	 * @brief latency distribution of one stage
+	 */
+	struct Histogram {
+		uint16_t count[BUCKETS];	///< presses per bucket, saturated
+		uint32_t maxUs;				///< the longest one
+		uint32_t sumUs;				///< all together, for the mean
+		uint32_t n;					///< presses recorded
+	};
+	LatencyTrace():state(IDLE),at(),hist(),unrendered(0) {
+	}
+	/**
+	 * @brief the button interrupt, starts the trace unless one is in progress
+	 *
+	 * A glitch settles without a press event, so the next interrupt finds
+	 * the trace still PRESSED and starts it over
+	 */
+	void press(uint32_t us) {
+		// the previous press was handled without a frame
+		if (state == HANDLED)
+			unrendered++;
+		if (state == IDLE || state == HANDLED || state == PRESSED) {
+			at[0] = us;
+			state = PRESSED;
+		}
+	}
+	/** @brief the press event is taken from the queue */
+	void dequeued(uint32_t us) {
+		if (state == PRESSED) {
+			at[1] = us;
+			state = DEQUEUED;
+		}
+	}
+	/** @brief handleEvent() returned */
+	void handled(uint32_t us) {
+		if (state == DEQUEUED) {
+			at[2] = us;
+			state = HANDLED;
+		}
+	}
+	/** @brief a frame started, the first one after the event is the response */
+	void frameStarted(uint32_t us) {
+		if (state == DEQUEUED || state == HANDLED) {
+			// drawn from handleEvent() itself
+			if (state == DEQUEUED)
+				at[2] = us;
+			at[3] = us;
+			state = FRAME;
+		}
+	}
+	/** @brief the frame transfer completed */
+	void frameDone(uint32_t us) {
+		if (state != FRAME)
+			return;
+		record(QUEUE, at[1] - at[0]);
+		record(HANDLE, at[2] - at[1]);
+		record(RENDER, at[3] - at[2]);
+		record(SPI, us - at[3]);
+		record(TOTAL, us - at[0]);
+		state = IDLE;
+	}
+	/** @brief the histogram of the stage */
+	const Histogram &get(Stage s) const {
+		return hist[s];
+	}
+	/** @brief presses handled without any frame, so not recorded */
+	uint32_t getUnrendered() const {
+		return unrendered;
+	}
+protected:
+	/**
+	 * @brief where the traced press is
+	 */
+	enum State: uint8_t {
+		IDLE,		///< waiting for a press
+		PRESSED,	///< in the queue
+		DEQUEUED,	///< being handled
+		HANDLED,	///< waiting for the frame
+		FRAME,		///< the frame is being sent
+	};
+	volatile State state;	///< of the traced press
+	uint32_t at[4];			///< us of press, dequeue, handled and frame start
+	Histogram hist[STAGES];	///< per stage
+	uint32_t unrendered;	///< traces dropped for no frame
+	/** @brief add the stage time to its histogram */
+	void record(Stage s, uint32_t us) {
+		Histogram &h = hist[s];
+		int b = 0;
+		while (b < BUCKETS-1 && (us >> (b+1)) != 0)
+			b++;
+		if (h.count[b] != 0xffff)
+			h.count[b]++;
+		if (us > h.maxUs)
+			h.maxUs = us;
+		h.sumUs += us;
+		h.n++;
+	}
+};
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * @file
+ * @brief Conway's Life engine working on PCD8544 buffer layout
+ * @author Denis Kokarev
+ */
+
+#include "life.h"
+
+/**
+ * @brief 2 bit sums of 3 vertically adjacent cells for one column
+ */
+struct ColumnSum {
+	uint8_t lo[LIFE_MAX_BANKS];	///< sum bit 0
+	uint8_t hi[LIFE_MAX_BANKS];	///< sum bit 1
+};
+
+/**
+ * @brief each cell plus its upper and lower neighbours
+ */
+static void columnSum(ColumnSum &s, const uint8_t *col, int16_t w, uint8_t banks) {
+	for (uint8_t b=0; b<banks; b++) {
+		uint8_t c = col[b*w];
+		uint8_t above = col[((b + banks - 1) % banks)*w];
+		uint8_t below = col[((b + 1) % banks)*w];
+		uint8_t u = (c << 1) | (above >> 7);	// the upper neighbours
+		uint8_t d = (c >> 1) | (below << 7);	// the lower neighbours
+		uint8_t uc = u ^ c;
+		s.lo[b] = uc ^ d;
+		s.hi[b] = (u & c) | (d & uc);
+	}
+}
+
+void life_step(uint8_t *buf, int16_t w, uint8_t banks) {
+	ColumnSum sums[3];
+	ColumnSum first;
+	ColumnSum *left = &sums[0];
+	ColumnSum *mid = &sums[1];
+	ColumnSum *right = &sums[2];
+	columnSum(*left, &buf[w-1], w, banks);
+	columnSum(*mid, &buf[0], w, banks);
+	first = *mid;
+	for (int16_t x=0; x<w; x++) {
+		// the right column is still intact, and the left one is in the sums
+		if (x+1 < w)
+			columnSum(*right, &buf[x+1], w, banks);
+		else
+			*right = first;
+		for (uint8_t b=0; b<banks; b++) {
+			// 9 cells sum = lo + 2*b1 + 4*b2 + 8*b3
+			uint8_t l1 = left->lo[b], l2 = mid->lo[b], l3 = right->lo[b];
+			uint8_t h1 = left->hi[b], h2 = mid->hi[b], h3 = right->hi[b];
+			uint8_t lo = l1 ^ l2 ^ l3;
+			uint8_t carry = (l1 & l2) | (l3 & (l1 ^ l2));
+			uint8_t h12 = h1 ^ h2;
+			uint8_t t = h12 ^ h3;
+			uint8_t c1 = (h1 & h2) | (h3 & h12);
+			uint8_t b1 = t ^ carry;
+			uint8_t c2 = t & carry;
+			uint8_t b2 = c1 ^ c2;
+			uint8_t b3 = c1 & c2;
+			uint8_t &cell = buf[x + b*w];
+			// born or survives with 3 in total, survives with 4 in total
+			cell = ~b3 & ((lo & b1 & ~b2) | (cell & ~lo & ~b1 & b2));
+		}
+		ColumnSum *done = left;
+		left = mid;
+		mid = right;
+		right = done;
+	}
+}
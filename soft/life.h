@@ -0,0 +1,29 @@
+/**
+ * @file
+ * @brief Conway's Life engine working on PCD8544 buffer layout
+ *
+ * Every byte is a column of 8 cells, LSB on top, so one bitwise
+ * operation handles 8 cells at once. Neighbours are counted by
+ * bit-sliced adders: 3 cells of every column first, then 3 columns
+ * @author Denis Kokarev
+ */
+#ifndef _LIFE_H
+#define _LIFE_H
+
+#include <cstdint>
+
+/// the tallest field life_step() handles
+constexpr int LIFE_MAX_BANKS = 16;
+
+/**
+ * @brief advance the field by one generation in place
+ *
+ * The field wraps around on all sides. Only 4 column sums are kept
+ * aside, so no second field is needed
+ * @param buf - cells, bit set - alive, banks of w bytes one after another
+ * @param w - width in cells, at least 2
+ * @param banks - height in 8 cell banks, 2 .. LIFE_MAX_BANKS
+ */
+void life_step(uint8_t *buf, int16_t w, uint8_t banks);
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Conway's Life for our STM32 mini-console
+ * @author Denis Kokarev
+ */
+
+#include "life_program.h"
+#include "life.h"
+#include "cycles.h"
+
+LifeProgram::LifeProgram():Program(false),paused(false),rnd(1),secondStart(0),
+						   secondGens(0),lastStart(0),lifeStats() {
+}
+
+void LifeProgram::init() {
+	Program::init();
+	// the generations run flat out
+	setClock(CLOCK_72MHZ);
+	paused = false;
+	lifeStats = LifeStats();
+	rnd ^= HAL_GetTick() ^ cycles();
+	seed();
+	secondStart = HAL_GetTick();
+	secondGens = 0;
+	lastStart = cycles();
+}
+
+void LifeProgram::seed() {
+	display.sync();
+	uint8_t *p = display.getBuffer();
+	for (int i=0; i<PCD8544_VWIDTH*PCD8544_VHEIGHT/8; i++) {
+		// xorshift32, two random bytes ANDed give 1/4 density
+		rnd ^= rnd << 13;
+		rnd ^= rnd >> 17;
+		rnd ^= rnd << 5;
+		p[i] = rnd & (rnd >> 8);
+	}
+	display.display();
+}
+
+Event LifeProgram::handleEvent(Event event) {
+	switch(event) {
+	case Event::EV_KEY_ENTER:
+		seed();
+		break;
+	case Event::EV_KEY_DOWN:
+		if (current.data)
+			break;	// auto-repeat of the held key
+		paused = !paused;
+		setClock(paused ? CLOCK_8MHZ : CLOCK_72MHZ);
+		secondStart = HAL_GetTick();
+		secondGens = lifeStats.generations;
+		break;
+	case Event::EV_KEY_LEFT:
+		if (caller)
+			return back();
+		break;
+	default:
+		break;
+	}
+	return Event::EV_NONE;
+}
+
+void LifeProgram::generation() {
+	display.sync();	// the previous generation has left the canvas
+	uint32_t start = cycles();
+	life_step(display.getBuffer(), PCD8544_VWIDTH, PCD8544_VHEIGHT/8);
+	lifeStats.stepCycles = cycles() - start;
+	display.display();
+	lifeStats.frameCycles = start - lastStart;
+	lastStart = start;
+	lifeStats.generations++;
+	uint32_t now = HAL_GetTick();
+	if (now - secondStart >= 1000) {
+		lifeStats.perSecond = lifeStats.generations - secondGens;
+		secondGens = lifeStats.generations;
+		secondStart = now;
+	}
+}
+
+void LifeProgram::execute() {
+	enter();
+
+	while (true) {
+		runTimers();
+		Event event = nextEvent();
+		if (event != Event::EV_NONE) {
+			Event he = handleEvent(event);
+			if (isKey(event))
+				noteHandled();
+			if (he == Event::EV_CLOSE)
+				return;
+		} else if (paused) {
+			if (!runTasks())
+				idle();
+		} else {
+			generation();
+		}
+	}
+}
+
+/**
+ * @brief not the main program, reversy switches to it
+ */
+LifeProgram lifeProgram;
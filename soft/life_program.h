@@ -0,0 +1,67 @@
+/**
+ * @file
+ * @brief Conway's Life for our STM32 mini-console
+ *
+ * Runs life_step() on the whole display canvas as fast as the SPI
+ * link takes the frames, which also makes it a display pipeline
+ * throughput benchmark
+ * @author Denis Kokarev
+ */
+#ifndef _LIFE_PROGRAM_H
+#define _LIFE_PROGRAM_H
+
+#include "program.h"
+
+/**
+ * @brief Life program, started by another one via switchTo()
+ *
+ * Keys: ENTER - new random field, DOWN - pause/resume,
+ * LEFT - back() to the caller
+ */
+class LifeProgram: public Program {
+public:
+	/**
+	 * @brief generation counters, watch them from the debugger
+	 */
+	struct LifeStats {
+		uint32_t generations;	///< generations computed since init()
+		uint32_t perSecond;		///< generations in the last full second
+		uint32_t stepCycles;	///< CPU cycles of the last life_step()
+		uint32_t frameCycles;	///< cycles between the last two generations
+	};
+	/** @brief not registered as the main program */
+	LifeProgram();
+	/** @brief random field */
+	virtual void init() override;
+	/** @brief keys */
+	virtual Event handleEvent(Event event) override;
+	/**
+	 * @brief a generation per loop while no events are pending
+	 *
+	 * The next generation is computed as soon as the previous one
+	 * is pushed, so the rate is bound by the SPI link
+	 */
+	virtual void execute() override;
+	/** @brief how fast it goes */
+	const LifeStats &getLifeStats() const {
+		return lifeStats;
+	}
+protected:
+	bool paused;			///< sleep instead of computing generations
+	uint32_t rnd;			///< random generator state
+	uint32_t secondStart;	///< HAL tick the current second began
+	uint32_t secondGens;	///< generations at that moment
+	uint32_t lastStart;		///< cycles() at the previous generation
+	LifeStats lifeStats;	///< counters
+	/** @brief fill the canvas with ~1/4 of live cells */
+	void seed();
+	/** @brief compute and push the next generation */
+	void generation();
+};
+
+/**
+ * @brief the only Life program instance
+ */
+extern LifeProgram lifeProgram;
+
+#endif
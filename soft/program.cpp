@@ -8,6 +8,12 @@
 #include "gpio.h"
 #include "spi.h"	// has hspi1
 #include "rtc.h"
+#include "cycles.h"
+#include "keypad.h"
+#include "timerwheel.h"
+#include "task.h"
+#include "latency.h"
+#include "rtctime.h"
 
 /*
  * all of these must match the CubeMX initialized PINs
@@ -17,58 +23,197 @@ const static STM_HAL_Pin dc {GPIOB, GPIO_PIN_7};		///< our data/command hardware
 const static STM_HAL_Pin cs {GPIOB, GPIO_PIN_6};		///< our SPI chip select pin as per schematics
 const static STM_HAL_Pin rst {GPIOA, GPIO_PIN_15};		///< our reset screen pin as per schematics
 
+/**
+ * @brief the one LCD all programs draw on
+ */
+static AF_PCD8544_HAL lcd(hspi1, dc, cs, rst);
+static bool lcdReady;	///< lcd reset and set up
+
 /*** Events Queue *************************************/
 
+/* our events queue */
+static EventQueue eventQueue;
+
 /**
- * @brief Our system event queue is a ring buffer
+ * @brief our global events queue, lock-free lanes of EventQueue
  */
-class RingbufQueue: public EventQueue {
-protected:
-	Event *q;	///< memory location for the ringbuf
-	int sz;		///< size of the buffer
-	int h;		///< head of the queue
-	int t;		///< tail of the queue
-public:
-	/**
-	 * @brief initialize the RingBuffer on the predefined buffer
-	 * @param _q - event buffer location
-	 * @param _sz - sz its size in number of events
-	 */
-	RingbufQueue(Event *_q, int _sz):q(_q),sz(_sz),h(0),t(0) {
-	}
-	/**
-	 * @brief simple implementation
-	 */
-	virtual Event get() override {
-		if (t != h) {
-			Event rc = q[h];
-			h = (h+1) % sz;
-			return rc;
-		} else {
-			return Event::EV_NONE;
-		}
+EventQueue *events = &eventQueue;
+
+/*** Timers *****************************************/
+
+/**
+ * @brief all the software timers, 16 slots of 1ms, 16ms, 256ms and 4s, farther than 65s ones wait in the top level
+ */
+static TimerWheel<> timerWheel;
+
+void Program::startTimer(Timer &t, uint32_t ms, uint32_t period) {
+	timerWheel.start(t, HAL_GetTick(), ms, period);
+}
+
+void Program::cancelTimer(Timer &t) {
+	timerWheel.cancel(t);
+}
+
+void Program::runTimers() {
+	timerWheel.advance(HAL_GetTick(), [](WheelTimer &wt) {
+		Timer &t = static_cast<Timer&>(wt);
+		events->put(t.event, t.data, EventQueue::LANE_TIMER);
+	});
+}
+
+/*** Tasks ******************************************/
+
+/**
+ * @brief background tasks of all programs
+ */
+static TaskScheduler<Program::MAX_TASKS> scheduler;
+
+bool Program::spawn(Task &t) {
+	return scheduler.spawn(t);
+}
+
+void Program::kill(Task &t) {
+	scheduler.kill(t);
+}
+
+bool Program::runTasks() {
+	return scheduler.run(HAL_GetTick());
+}
+
+/*** Latency ****************************************/
+
+/**
+ * @brief the key presses traced to the screen
+ */
+static LatencyTrace latency;
+
+/**
+ * @brief microseconds of the HAL tick, SysTick counts down within each ms at any clock profile
+ *
+ * With the interrupts disabled, so the tick stays put
+ */
+static uint32_t micros() {
+	uint32_t ms = HAL_GetTick();
+	uint32_t val = SysTick->VAL;
+	// wrapped, but the interrupt couldn't count it yet
+	if (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) {
+		val = SysTick->VAL;
+		ms++;
 	}
-	/**
-	 * @brief simple implementation
-	 */
-	virtual void put(Event e) override {
-		int nt = (t+1) % sz;
-		if (nt != h) {
-			q[t] = e;
-			t = nt;
-		} // otherwise just ignore
+	uint32_t load = SysTick->LOAD;
+	return ms*1000 + (load - val)*1000/(load + 1);
+}
+
+/**
+ * @brief a LatencyTrace step, they come from both the main loop and the interrupts
+ */
+static void traceStep(void (LatencyTrace::*step)(uint32_t)) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	(latency.*step)(micros());
+	__set_PRIMASK(primask);
+}
+
+static uint32_t sendingSince;	///< micros() the frame being sent started at
+static uint32_t sentUs;			///< microseconds the frames took to send, all together
+
+/**
+ * @brief AF_PCD8544_HAL frame start and completion
+ */
+static void frameHook(bool done) {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t us = micros();
+	if (done) {
+		sentUs += us - sendingSince;
+		latency.frameDone(us);
+	} else {
+		sendingSince = us;
+		latency.frameStarted(us);
 	}
+	__set_PRIMASK(primask);
+}
+
+/**
+ * @brief micros() from the main loop
+ */
+static uint32_t microsNow() {
+	uint32_t primask = __get_PRIMASK();
+	__disable_irq();
+	uint32_t us = micros();
+	__set_PRIMASK(primask);
+	return us;
+}
+
+const LatencyTrace &Program::getLatency() {
+	return latency;
+}
+
+void Program::noteHandled() {
+	traceStep(&LatencyTrace::handled);
+}
+
+/*** Keys *******************************************/
+
+constexpr uint16_t KEY_PINS = GPIO_PIN_3|GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7;	///< the buttons on GPIOA
+constexpr int KEY_SHIFT = 3;	///< the lowest button pin
+
+/**
+ * @brief key events by Keypad bit number, i.e. by pin from PA3 up
+ */
+static const Event keyEvents[] = {
+	Event::EV_KEY_DOWN, Event::EV_KEY_RIGHT, Event::EV_KEY_ENTER, Event::EV_KEY_LEFT, Event::EV_KEY_UP
 };
 
-/* our events queue */
-constexpr int EQ_SZ = 16;
-static Event q[EQ_SZ];
-static RingbufQueue rbevents(q, EQ_SZ);
+/// the arrow keys in Keypad bits
+constexpr uint8_t ARROW_KEYS = 0x1b;
 
 /**
- * @brief our global events queue is an instance of RingbufQueue()
+ * @brief debouncer of the buttons, arrows auto-repeat
  */
-EventQueue *events = &rbevents;
+static Keypad keypad(ARROW_KEYS);
+
+/**
+ * @brief SysTick samples the buttons, their EXTI lines are masked meanwhile
+ */
+static volatile bool scanning;
+
+/**
+ * @brief first edge of a press, sample the buttons from now on
+ */
+static void startScan() {
+	traceStep(&LatencyTrace::press);
+	EXTI->IMR &= ~KEY_PINS;
+	scanning = true;
+}
+
+/**
+ * @brief one 1ms sample of the buttons from SysTick
+ *
+ * Once all are released and stable, the EXTI lines wait for the next press.
+ * A press sneaking in before they're unmasked gets no edge, so it is
+ * caught by reading the pins once more
+ */
+static void scanKeys() {
+	keypad.sample((GPIOA->IDR & KEY_PINS) >> KEY_SHIFT, [](uint8_t k, Keypad::Action a, uint8_t n) {
+		if (a == Keypad::RELEASE)
+			events->put(Event::EV_KEY_RELEASE, uint8_t(keyEvents[k]), EventQueue::LANE_INPUT);
+		else
+			events->put(keyEvents[k], n, EventQueue::LANE_INPUT);
+	});
+	if (keypad.settled()) {
+		__HAL_GPIO_EXTI_CLEAR_IT(KEY_PINS);
+		EXTI->IMR |= KEY_PINS;
+		if (GPIOA->IDR & KEY_PINS)
+			EXTI->IMR &= ~KEY_PINS;
+		else
+			scanning = false;
+	}
+}
+
+void Program::setKeyRepeat(uint16_t delay, uint16_t period) {
+	keypad.setRepeat(delay ? ARROW_KEYS : 0, delay, period);
+}
 
 /*** Program ******************************************/
 
@@ -88,20 +233,324 @@ void Program::setMainProgram(Program *p) {
  * Merely declare your Program object to register it as main program
  * If you'll be declaring multiple programs the last constructed one
  * will become main_program
- * In that case, it would be a good idea to incapsulate all programs
- * into a single global object to specify which one to be created last
+ * In that case, construct the others with Program(false) and let the
+ * main one switchTo() them
  */
-Program::Program():display(hspi1, dc, cs, rst),refresh(1) {
-	setMainProgram(this);
+Program::Program():Program(true) {
+}
+
+Program::Program(bool primary):display(lcd),refresh(1),refreshTimer(),caller(nullptr),resuming(false),current(),heldKey(),heldShown(0),animations(),invalid(false),windowsShown(0),
+				   tickPeriod(0),maxCatchUp(1),nextUpdate(0),frameIdle(0),frameSpi(0),
+				   renderStats(),frameStats(),idleStats() {
+	if (primary)
+		setMainProgram(this);
+}
+
+Event Program::switchTo(Program *p) {
+	cancelTimer(refreshTimer);
+	p->caller = this;
+	setMainProgram(p);
+	return Event::EV_CLOSE;
+}
+
+Event Program::back() {
+	cancelTimer(refreshTimer);
+	caller->resuming = true;
+	setMainProgram(caller);
+	return Event::EV_CLOSE;
 }
 
 /** typical program initialization */
 void Program::init() {
-	display.begin();
+	// the programs switched to find it set up, the cycle counter running under their timings
+	if (!lcdReady) {
+		cycles_init();
+		display.begin();
+		display.setFrameHook(frameHook);
+		lcdReady = true;
+	}
+	startTimer(refreshTimer, 1000*refresh, 1000*refresh);
+}
+
+void Program::resume() {
+	startTimer(refreshTimer, 1000*refresh, 1000*refresh);
+	invalidate();
+}
+
+void Program::enter() {
+	if (resuming) {
+		resuming = false;
+		resume();
+	} else {
+		init();
+	}
 }
 
-/* need this fn defined in main.c, which is not exported */
-extern "C" void SystemClock_Config(void);
+/*** Clock *****************************************/
+
+/**
+ * @brief what Program::ClockProfile takes to set up
+ */
+struct ClockSetting {
+	uint32_t pllState;	///< RCC_PLL_ON or RCC_PLL_OFF
+	uint32_t prediv;	///< HSE divider in front of the PLL
+	uint32_t sysclk;	///< system clock source, the RCC_CFGR_SW value
+	uint32_t latency;	///< flash wait states, 1 per 24MHz
+	uint32_t apbDiv;	///< both APB buses, PCLK1 up to 36MHz, the RCC_CFGR_PPRE1 value
+	uint32_t spiDiv;	///< SPI1 prescaler on PCLK2
+};
+
+/**
+ * @brief the profiles, HSE is 8MHz
+ */
+static const ClockSetting clockSettings[Program::CLOCK_PROFILES] = {
+	// SPI 8MHz/2 = 4MHz
+	{RCC_PLL_OFF, RCC_HSE_PREDIV_DIV1, RCC_SYSCLKSOURCE_HSE, FLASH_LATENCY_0, RCC_HCLK_DIV1, SPI_BAUDRATEPRESCALER_2},
+	// SPI 36MHz/2/4 = 4.5MHz
+	{RCC_PLL_ON, RCC_HSE_PREDIV_DIV2, RCC_SYSCLKSOURCE_PLLCLK, FLASH_LATENCY_1, RCC_HCLK_DIV2, SPI_BAUDRATEPRESCALER_4},
+	// SPI 72MHz/4/4 = 4.5MHz, the same as SystemClock_Config()
+	{RCC_PLL_ON, RCC_HSE_PREDIV_DIV1, RCC_SYSCLKSOURCE_PLLCLK, FLASH_LATENCY_2, RCC_HCLK_DIV4, SPI_BAUDRATEPRESCALER_4},
+};
+
+static Program::ClockProfile clockProfile = Program::CLOCK_72MHZ;	///< set by SystemClock_Config() at boot
+static Program::ClockStats clockStats;	///< time on each profile
+static uint32_t clockSince;				///< HAL tick clockProfile was set at
+
+constexpr uint32_t RDY_POLLS = 200000;	///< HSE_STARTUP_TIMEOUT of 100ms at 8MHz at least, in loop passes
+
+/**
+ * @brief wait for the RCC to get there
+ *
+ * Counted in loop passes, the HAL tick stands still on the wakeup path
+ */
+static void waitRcc(volatile uint32_t &reg, uint32_t mask, uint32_t value) {
+	for (uint32_t n = 0; (reg & mask) != value; n++)
+		if (n == RDY_POLLS)
+			Error_Handler();
+}
+
+/**
+ * @brief the system clock source, the bus dividers and the flash wait states
+ *
+ * The wait states and the dividers go up before the clock does and down after it
+ */
+static void setSysclk(const ClockSetting &c) {
+	uint32_t ppre = RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2;
+	uint32_t div = c.apbDiv | (c.apbDiv << 3);
+	bool up = c.latency > (FLASH->ACR & FLASH_ACR_LATENCY);
+	if (up) {
+		FLASH->ACR = (FLASH->ACR & ~FLASH_ACR_LATENCY) | c.latency;
+		RCC->CFGR = (RCC->CFGR & ~ppre) | div;
+	}
+	RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | c.sysclk;
+	waitRcc(RCC->CFGR, RCC_CFGR_SWS, c.sysclk << RCC_CFGR_SWS_Pos);
+	if (!up) {
+		RCC->CFGR = (RCC->CFGR & ~ppre) | div;
+		FLASH->ACR = (FLASH->ACR & ~FLASH_ACR_LATENCY) | c.latency;
+	}
+}
+
+/**
+ * @brief switch to the profile from whatever clock runs now, HSI after STOP mode included
+ *
+ * The PLL can't be changed while it's the system clock, so the switch goes via HSE.
+ * By the registers rather than HAL_RCC_OscConfig(): that one sets PREDIV only
+ * along with HSE, and it times out by the HAL tick, which is stopped after STOP
+ */
+static void applyClock(Program::ClockProfile p) {
+	const ClockSetting &c = clockSettings[p];
+	SET_BIT(RCC->CR, RCC_CR_HSEON);
+	waitRcc(RCC->CR, RCC_CR_HSERDY, RCC_CR_HSERDY);
+	setSysclk(clockSettings[Program::CLOCK_8MHZ]);
+	// PREDIV and PLLMUL take with the PLL off only
+	CLEAR_BIT(RCC->CR, RCC_CR_PLLON);
+	waitRcc(RCC->CR, RCC_CR_PLLRDY, 0);
+	if (c.pllState == RCC_PLL_ON) {
+		__HAL_RCC_HSE_PREDIV_CONFIG(c.prediv);
+		__HAL_RCC_PLL_CONFIG(RCC_PLLSOURCE_HSE, RCC_PLL_MUL9);
+		SET_BIT(RCC->CR, RCC_CR_PLLON);
+		waitRcc(RCC->CR, RCC_CR_PLLRDY, RCC_CR_PLLRDY);
+		setSysclk(c);
+	}
+	SystemCoreClockUpdate();
+	// the prescaler changes with SPI off, the next transfer enables it. After STOP it's the same
+	if ((hspi1.Instance->CR1 & SPI_CR1_BR) != c.spiDiv) {
+		hspi1.Instance->CR1 &= ~SPI_CR1_SPE;
+		hspi1.Instance->CR1 = (hspi1.Instance->CR1 & ~SPI_CR1_BR) | c.spiDiv;
+		hspi1.Init.BaudRatePrescaler = c.spiDiv;
+	}
+	// 1ms HAL tick, at the priority SystemClock_Config() gives it
+	HAL_SYSTICK_Config(SystemCoreClock/1000);
+	HAL_NVIC_SetPriority(SysTick_IRQn, 0, 0);
+}
+
+void Program::setClock(ClockProfile p) {
+	if (p == clockProfile)
+		return;
+	if (main_program)
+		main_program->display.sync();
+	uint32_t now = HAL_GetTick();
+	clockStats.ms[clockProfile] += now - clockSince;
+	clockSince = now;
+	clockStats.switches++;
+	clockProfile = p;
+	applyClock(p);
+}
+
+Program::ClockProfile Program::getClock() {
+	return clockProfile;
+}
+
+Program::ClockStats Program::getClockStats() {
+	ClockStats st = clockStats;
+	st.ms[clockProfile] += HAL_GetTick() - clockSince;
+	return st;
+}
+
+/*** Tickless idle ***********************************/
+
+constexpr uint32_t WAKEUP_HZ = 2500;	///< RTC wakeup timer ticks a second, RTCCLK/16 of 40kHz LSI
+constexpr uint32_t MAX_SLEEP_MS = 0x10000*1000/WAKEUP_HZ;	///< the longest wakeup timer period, ~26s
+
+static bool wakeupArmed;		///< the RTC wakeup timer counts towards wakeupDeadline
+static uint32_t wakeupDeadline;	///< HAL tick the timer fires at
+
+constexpr uint32_t STOP_MIN_MS = 20;		///< shorter idle doesn't pay for restoring the clocks
+constexpr uint32_t INPUT_ACTIVE_MS = 2000;	///< the user is pressing keys if the last one came this recently
+
+constexpr uint32_t STOP_EXIT_US = 10;		///< regulator and HSI start before the core runs, rounded up from the datasheet
+constexpr uint8_t STOP_RETRY = 32;			///< STOP anyway on every so many long idles to measure it again
+
+static uint16_t wakeLatencyUs = 4000;	///< STOP mode wakeup ceiling, @see Program::setWakeLatency()
+static uint8_t stopsSkipped;			///< long idles in SLEEP since STOP wakeup got over the ceiling
+static uint32_t lastInput;				///< HAL tick of the last key press
+static uint32_t inputGap = INPUT_ACTIVE_MS;	///< running average of the gaps between the presses
+
+/**
+ * @brief microseconds since the wakeup, some of them on HSI before the PLL is back
+ * @param exitUs - before the core ran, the cycle counter doesn't count then
+ */
+static uint16_t wakeUs(uint32_t woke, uint32_t clocked, uint32_t now, uint32_t exitUs) {
+	uint32_t us = exitUs + (clocked - woke)/(HSI_VALUE/1000000) + (now - clocked)/(SystemCoreClock/1000000);
+	return (us > 0xffff) ? 0xffff : us;
+}
+
+/**
+ * @brief RTC time of day in synchronous prescaler ticks
+ */
+static uint32_t rtcTicks() {
+	uint32_t ss = RTC->SSR;	// freezes TR and DR until DR is read
+	uint32_t tr = RTC->TR;
+	(void)RTC->DR;
+	return RtcTime(RTC->PRER, LSI_VALUE).ticks(tr, ss);
+}
+
+/**
+ * @brief ms between two rtcTicks() readings, midnight included
+ */
+static uint32_t rtcElapsed(uint32_t from, uint32_t to) {
+	return RtcTime(RTC->PRER, LSI_VALUE).elapsedMs(from, to);
+}
+
+/**
+ * @brief make up for the HAL ticks missed while SysTick was suspended
+ *
+ * At once rather than HAL_IncTick() by one, it's on the wakeup path
+ */
+static void advanceTick(uint32_t ms) {
+	uwTick += ms;
+}
+
+void Program::sleepUntil(uint32_t deadline, bool stop) {
+	uint32_t now = HAL_GetTick();
+	int32_t ms = deadline - now;
+	if (ms <= 0)
+		return;
+	bool tickNeeded = scanning;
+#if PCD8544_GRAY_PLANES
+	// grayscale planes are paced by the tick
+	tickNeeded = tickNeeded || display.grayActive();
+#endif
+	if (ms == 1 || tickNeeded) {
+		// SysTick wakes us up within a ms anyway
+		tickSleep();
+		return;
+	}
+	if (uint32_t(ms) > MAX_SLEEP_MS) {
+		ms = MAX_SLEEP_MS;
+		deadline = now + ms;
+	}
+	// woken up early, the timer still counts towards the same deadline
+	if (!wakeupArmed || wakeupDeadline != deadline) {
+		// rounded to the nearest timer tick
+		HAL_RTCEx_SetWakeUpTimer_IT(&hrtc, (ms*WAKEUP_HZ + 500)/1000 - 1, RTC_WAKEUPCLOCK_RTCCLK_DIV16);
+		wakeupDeadline = deadline;
+		wakeupArmed = true;
+		idleStats.rearms++;
+	}
+	// the clocks stop under the DMA otherwise
+	if (stop)
+		display.sync();
+	uint32_t before = rtcTicks();
+
+	/* A press may start the buttons sampling right before WFI, which still
+	   wakes up on the pending interrupt with interrupts disabled */
+	__disable_irq();
+	if (scanning) {
+		__enable_irq();
+		return;
+	}
+
+	/*Suspend Tick increment to prevent wakeup by Systick interrupt. 
+	  Otherwise the Systick interrupt will wake up the device within 1ms (HAL time base)*/
+	HAL_SuspendTick();
+
+	uint32_t woke, clocked;
+	if (stop) {
+		/* Enter Stop Mode */
+		HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+		woke = cycles();
+		/* Configures system clock after wake-up from STOP: HSI runs it, back to our profile */
+		applyClock(clockProfile);
+		clocked = cycles();
+		/* The calendar shadow registers missed the updates */
+		__HAL_RTC_WRITEPROTECTION_DISABLE(&hrtc);
+		HAL_RTC_WaitForSynchro(&hrtc);
+		__HAL_RTC_WRITEPROTECTION_ENABLE(&hrtc);
+	} else {
+		/* Request to enter SLEEP mode */
+		HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+		woke = clocked = cycles();
+	}
+
+	// the wakeup timer period is exact, otherwise the calendar tells to a subsecond tick, 3.2ms
+	bool timeout = __HAL_RTC_WAKEUPTIMER_GET_FLAG(&hrtc, RTC_FLAG_WUTF) != RESET;
+	uint32_t slept = ms;
+	if (!timeout) {
+		slept = rtcElapsed(before, rtcTicks());
+		if (slept >= uint32_t(ms))
+			slept = ms - 1;
+		idleStats.early++;
+	}
+	advanceTick(slept);
+	idleStats.sleeps++;
+	idleStats.sleptMs += slept;
+
+	/* Resume Tick interrupt if disabled prior to sleep mode entry*/
+	HAL_ResumeTick();
+	uint16_t us = wakeUs(woke, clocked, cycles(), stop ? STOP_EXIT_US : 0);
+	if (stop) {
+		// one slow wakeup doesn't rule STOP out for good
+		idleStats.stopWakeAvgUs = idleStats.stops ? (3*idleStats.stopWakeAvgUs + us)/4 : us;
+		idleStats.stops++;
+		idleStats.stopMs += slept;
+		if (us > idleStats.stopWakeUs)
+			idleStats.stopWakeUs = us;
+	} else if (us > idleStats.sleepWakeUs) {
+		idleStats.sleepWakeUs = us;
+	}
+	__enable_irq();
+}
 
 /**
  * enter STOPSLEEP mode - best energy efficiency slower wakeup
@@ -109,19 +558,11 @@ extern "C" void SystemClock_Config(void);
  * or on timeout
  */
 void Program::stopSleep(int sec) {
-	/* Disable Wake-up timer */
-	HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
-	HAL_RTCEx_SetWakeUpTimer_IT(&hrtc, 2500*sec, RTC_WAKEUPCLOCK_RTCCLK_DIV16);
-	/* Enter Stop Mode */
-	HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
-
-	/* Configures system clock after wake-up from STOP: enable HSI and PLL with HSI as source*/
-	SystemClock_Config();
-	/* Disable Wake-up timer */
-	if (HAL_RTCEx_DeactivateWakeUpTimer(&hrtc) != HAL_OK) {
-		/* Initialization Error */
-		Error_Handler(); 
-	}
+	uint32_t deadline = HAL_GetTick() + 1000*sec;
+	// SysTick stops in STOP mode, sleepUntil() keeps it while the buttons are sampled
+	sleepUntil(deadline, !scanning);
+	if (int32_t(HAL_GetTick() - deadline) >= 0)
+		events->put(Event::EV_TIMER, EventQueue::LANE_TIMER);
 }
 
 /**
@@ -130,50 +571,249 @@ void Program::stopSleep(int sec) {
  * or on timeout
  */
 void Program::sleepSleep(int sec) {
-	/* Disable Wake-up timer */
-	HAL_RTCEx_DeactivateWakeUpTimer(&hrtc);
-	HAL_RTCEx_SetWakeUpTimer_IT(&hrtc, 2500*sec, RTC_WAKEUPCLOCK_RTCCLK_DIV16);
+	uint32_t deadline = HAL_GetTick() + 1000*sec;
+	sleepUntil(deadline);
+	if (int32_t(HAL_GetTick() - deadline) >= 0)
+		events->put(Event::EV_TIMER, EventQueue::LANE_TIMER);
+}
 
-	/*Suspend Tick increment to prevent wakeup by Systick interrupt. 
-	  Otherwise the Systick interrupt will wake up the device within 1ms (HAL time base)*/
-	HAL_SuspendTick();
+void Program::idle() {
+	uint32_t deadline = nextDeadline();
+	uint32_t now = HAL_GetTick();
+	uint32_t expected = deadline - now;
+	if (now - lastInput < INPUT_ACTIVE_MS && inputGap < expected)
+		expected = inputGap;
+	// the frame being sent needs the clocks running
+	bool stop = expected >= STOP_MIN_MS && wakeLatencyUs > 0 && !display.busy();
+	if (stop && idleStats.stopWakeAvgUs > wakeLatencyUs && ++stopsSkipped < STOP_RETRY)
+		stop = false;
+	if (stop)
+		stopsSkipped = 0;
+	sleepUntil(deadline, stop);
+}
 
-	/* Request to enter SLEEP mode */
+void Program::noteInput() {
+	uint32_t now = HAL_GetTick();
+	uint32_t gap = now - lastInput;
+	if (gap > INPUT_ACTIVE_MS)
+		gap = INPUT_ACTIVE_MS;
+	inputGap = (3*inputGap + gap)/4;
+	lastInput = now;
+	traceStep(&LatencyTrace::dequeued);
+}
+
+void Program::setWakeLatency(uint16_t us) {
+	wakeLatencyUs = us;
+}
+
+uint32_t Program::nextDeadline() {
+	uint32_t next = HAL_GetTick() + MAX_SLEEP_MS;
+	if (tickPeriod > 0 && int32_t(nextUpdate - next) < 0)
+		next = nextUpdate;
+	if (animating()) {
+		uint32_t step = nextAnimationStep();
+		if (int32_t(step - next) < 0)
+			next = step;
+	}
+	if (!timerWheel.empty()) {
+		uint32_t expiry = timerWheel.nextExpiry();
+		if (int32_t(expiry - next) < 0)
+			next = expiry;
+	}
+	scheduler.nextWake(next);
+	return next;
+}
+
+/**
+ * enter SLEEP mode with the tick running - to be awoken
+ * by any interrupt within 1ms
+ */
+void Program::tickSleep() {
 	HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+}
 
-	/* Resume Tick interrupt if disabled prior to sleep mode entry*/
-	HAL_ResumeTick();
+/*** Animations ***************************************/
+
+void Program::animate(Animation *a, uint16_t delay) {
+	Running *slot = nullptr;
+	for (Running &r: animations) {
+		if (r.animation == a) {
+			slot = &r;
+			break;
+		} else if (!r.animation && !slot) {
+			slot = &r;
+		}
+	}
+	if (!slot) {
+		a->finish();
+		return;
+	}
+	slot->animation = a;
+	slot->due = HAL_GetTick() + delay;
+	slot->n = 0;
+}
+
+bool Program::animating() const {
+	for (const Running &r: animations)
+		if (r.animation)
+			return true;
+	return false;
+}
+
+void Program::runAnimations() {
+	for (Running &r: animations) {
+		Animation *a = r.animation;
+		if (!a || int32_t(HAL_GetTick() - r.due) < 0)
+			continue;
+		uint8_t n = r.n++;
+		uint16_t next = a->step(n);
+		if (r.animation != a || r.n != uint8_t(n+1))
+			continue;	// the step restarted or replaced it
+		if (next > 0)
+			r.due = HAL_GetTick() + next;
+		else
+			r.animation = nullptr;
+	}
+}
+
+uint32_t Program::nextAnimationStep() const {
+	uint32_t now = HAL_GetTick();
+	uint32_t next = now + UINT16_MAX;
+	for (const Running &r: animations)
+		if (r.animation && int32_t(r.due - next) < 0)
+			next = r.due;
+	return next;
+}
+
+void Program::skipAnimations() {
+	for (Running &r: animations) {
+		Animation *a = r.animation;
+		if (a) {
+			r.animation = nullptr;
+			a->finish();
+		}
+	}
+}
+
+/*** Rendering ****************************************/
+
+void Program::invalidate() {
+	if (invalid)
+		renderStats.coalesced++;
+	invalid = true;
+}
 
-	/* Disable Wake-up timer */
-	if (HAL_RTCEx_DeactivateWakeUpTimer(&hrtc) != HAL_OK) {
-		/* Initialization Error */
-		Error_Handler(); 
+/*** Fixed timestep ***********************************/
+
+void Program::setTickRate(uint8_t hz, uint8_t catchUp) {
+	tickPeriod = (hz > 0) ? 1000/hz : 0;
+	maxCatchUp = (catchUp > 0) ? catchUp : 1;
+	nextUpdate = HAL_GetTick() + tickPeriod;
+	frameIdle = 0;
+	frameSpi = sentUs;
+}
+
+void Program::fixedStep() {
+	uint32_t now = HAL_GetTick();
+	if (int32_t(now - nextUpdate) < 0) {
+		if (runTasks())
+			return;
+		uint32_t start = microsNow();
+		idle();
+		frameIdle += microsNow() - start;
+		return;
+	}
+	uint32_t start = microsNow();
+	uint8_t n = 0;
+	while (int32_t(now - nextUpdate) >= 0 && n < maxCatchUp) {
+		update();
+		nextUpdate += tickPeriod;
+		n++;
 	}
+	frameStats.updates += n;
+	if (n > 1)
+		frameStats.late++;
+	if (int32_t(now - nextUpdate) >= 0) {
+		// too far behind, drop the rest of the ticks
+		uint32_t behind = (now - nextUpdate)/tickPeriod + 1;
+		frameStats.missed += behind;
+		nextUpdate += behind*tickPeriod;
+	}
+	uint32_t updated = microsNow();
+	invalid = false;
+	render();
+	uint32_t rendered = microsNow();
+	uint32_t spi = sentUs;
+	frameStats.frames++;
+	frameStats.updateUs = updated - start;
+	frameStats.renderUs = rendered - updated;
+	frameStats.spiUs = spi - frameSpi;
+	frameStats.idleUs = frameIdle;
+	frameSpi = spi;
+	frameIdle = 0;
 }
 
 /**
  * @brief our typical execution loop
  */
 void Program::execute() {
-	init();
+	enter();
 
 	while (true) {
-		Event event = events->get();
+		runTimers();
+		runAnimations();
+		Event event = nextEvent();
 		switch(event) {
 		case Event::EV_NONE:
-			sleepSleep(refresh);
+			if (tickPeriod > 0) {
+				fixedStep();
+			} else if (invalid) {
+				// all events are handled, one frame for all of them
+				invalid = false;
+				renderStats.rendered++;
+				render();
+			} else if (!runTasks()) {
+				// till the animation step, a timer, a task wakeup or a key
+				idle();
+			}
 			break;
 		default:
+			if (isKey(event) && animating()) {
+				uint8_t shown = windowsShown;
+				skipAnimations();
+				// e.g. ENTER on the game over blink mustn't start the next game from the window it brings up
+				if (windowsShown != shown) {
+					noteHandled();
+					break;
+				}
+				// e.g. the machine's turn after the player's chips flipped goes first
+				if (!events->empty(EventQueue::LANE_APP)) {
+					heldKey = current;
+					heldShown = shown;
+					break;
+				}
+			}
+			startTimer(refreshTimer, 1000*refresh, 1000*refresh);
 			Event he = handleEvent(event);
+			if (isKey(event))
+				noteHandled();
 			if (he == Event::EV_CLOSE)
 				return;	// for example if main_program changed
 		}
 	}
 }
 
+/** periodic work that cannot wait for the event loop */
+void Program::tick() {
+#if PCD8544_GRAY_PLANES
+	display.grayTick();
+#endif
+}
+
 /** when need to change sleep cycle */
 void Program::setRefresh(int r) {
 	refresh = r;
+	startTimer(refreshTimer, 1000*refresh, 1000*refresh);
 }
 
 /*** WProgram *****************************************/
@@ -183,9 +823,28 @@ void Program::setRefresh(int r) {
  */
 void WProgram::setMainWindow(Window *w) {
 	mainWindow = w;
+	windowsShown++;
+	display.setBackground(nullptr);
+#if PCD8544_LAYER
+	if (mainWindow->drawStatic())
+		display.captureBackground();
+#endif
 	mainWindow->draw();
 }
 
+/*! WProgram renders its main window */
+void WProgram::render() {
+	mainWindow->draw();
+}
+
+/*! WProgram paints its main window from scratch, right away rather than by render() */
+void WProgram::resume() {
+	setRefresh(refresh);
+	invalid = false;
+	display.clearDisplay();
+	setMainWindow(mainWindow);
+}
+
 /*! WProgram simply delegates its main window to handle events */
 Event WProgram::handleEvent(Event event) {
 	return mainWindow->handleEvent(event);
@@ -198,27 +857,13 @@ extern "C" {
 	/**
 	 * @brief Buttons IRQ handler
 	 *
-	 * Convert interrupst into application level events
+	 * Only the first edge of a press gets here, it starts the sampling
+	 * from SysTick, which converts the debounced keys into application level events
 	 * The name of the function must exactly match to what HAL library expects
 	 */
 	void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin) {
-		switch (GPIO_Pin) {
-		case GPIO_PIN_3:
-			events->put(Event::EV_KEY_DOWN);
-			break;
-		case GPIO_PIN_4:
-			events->put(Event::EV_KEY_RIGHT);
-			break;
-		case GPIO_PIN_5:
-			events->put(Event::EV_KEY_ENTER);
-			break;
-		case GPIO_PIN_6:
-			events->put(Event::EV_KEY_LEFT);
-			break;
-		case GPIO_PIN_7:
-			events->put(Event::EV_KEY_UP);
-			break;
-		}
+		if (GPIO_Pin & KEY_PINS)
+			startScan();
 	}
 
 	/**
@@ -228,7 +873,24 @@ extern "C" {
 	 * The name of the function must exactly match to what HAL library expects
 	 */
 	void HAL_RTCEx_WakeUpTimerEventCallback(RTC_HandleTypeDef *hrtc) {
-		events->put(Event::EV_TIMER);
+		// one-shot, sleepUntil() arms it again
+		__HAL_RTC_WRITEPROTECTION_DISABLE(hrtc);
+		__HAL_RTC_WAKEUPTIMER_DISABLE(hrtc);
+		__HAL_RTC_WRITEPROTECTION_ENABLE(hrtc);
+		wakeupArmed = false;
+		// only ends the sleep, the main loop runs the timers which are due
+	}
+
+	/**
+	 * @brief SysTick 1ms IRQ handler
+	 *
+	 * The name of the function must exactly match to what HAL library expects
+	 */
+	void HAL_SYSTICK_Callback(void) {
+		if (scanning)
+			scanKeys();
+		if (main_program)
+			main_program->tick();
 	}
 
 	/**
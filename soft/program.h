@@ -8,10 +8,17 @@
  * or override execute() loop entirerly
  @ @author Denis Kokarev
  */
+#ifndef _PROGRAM_H
+#define _PROGRAM_H
 
 #include <cstdint>
 #include "exec.h"
 #include "AF_PCD8544_HAL.h"
+#include "spsc.h"
+#include "timerwheel.h"
+#include "task.h"
+#include "windowset.h"
+#include "latency.h"
 #include <type_traits>
 
 /**
@@ -20,12 +27,13 @@
 enum class Event: std::int8_t {
 	EV_NONE = 0,	///< nothing
 	EV_CLOSE,		///< pass the focus to another program
-	EV_TIMER,		///< wokeup on timer after sleep period
+	EV_TIMER,		///< refresh period passed with no events, sleep timed out
 	EV_KEY_LEFT,	///< left key pressed
 	EV_KEY_UP,		///< up key pressed
 	EV_KEY_DOWN,	///< down key pressed
 	EV_KEY_RIGHT,	///< right key pressed
 	EV_KEY_ENTER,   ///< center key pressed
+	EV_KEY_RELEASE,	///< key released, EventRecord::data is its press event
 	EV_CUSTOM,		///< used-defined events
 	EV_CUSTOM_1,
 	EV_CUSTOM_2,
@@ -45,22 +53,115 @@ constexpr Event operator+(const Event& x, int n) {
 }
 
 /**
- * @brief Abstract queue for our events
+ * @brief is it one of the keys
+ */
+constexpr bool isKey(Event e) {
+	return e >= Event::EV_KEY_LEFT && e <= Event::EV_KEY_ENTER;
+}
+
+/**
+ * @brief Event as it sits in the queue
+ *
+ * 4 bytes, so all the lanes of EventQueue take 80 bytes
+ */
+struct EventRecord {
+	Event type;		///< what happened
+	uint8_t data;	///< payload: auto-repeat count of the keys, 0 on press, or the program's own
+	uint16_t time;	///< HAL tick of put(), lower 16 bits, e.g. when the key was pressed
+	/**
+	 * @brief ms since put(), valid for ~65 seconds
+	 */
+	uint16_t age() const {
+		return uint16_t(HAL_GetTick()) - time;
+	}
+};
+static_assert(sizeof(EventRecord) == 4, "EventRecord must stay 4 bytes");
+
+/**
+ * @brief Queue for our events with a lock-free lane per producer
  *
  * to enqueue/dequeue events @see Event
+ * Every lane is a SpscQueue with exactly one producer: the program,
+ * the buttons sampling or the timers it runs. get() drains them in
+ * priority order, so a key never waits behind the timer events.
+ * The events are stamped with HAL tick as they are put
  */
 class EventQueue {
 public:
+	/**
+	 * @brief who puts the event, in get() priority order
+	 */
+	enum Lane {
+		LANE_APP = 0,	///< the program itself, continuation of what it started
+		LANE_INPUT,		///< the buttons, sampled from SysTick
+		LANE_TIMER,		///< the expired timers, put by the main loop
+		LANES
+	};
+	/**
+	 * get next event record from the queue
+	 * @param[out] r - the event, left intact if there is none
+	 * @return - false if no event available
+	 */
+	bool get(EventRecord &r) {
+		return app.get(r) || input.get(r) || timer.get(r);
+	}
+	/** @brief nothing to get from the lane, exact on the main loop side */
+	bool empty(Lane lane) const {
+		switch (lane) {
+		case LANE_INPUT:
+			return input.empty();
+		case LANE_TIMER:
+			return timer.empty();
+		default:
+			return app.empty();
+		}
+	}
 	/**
 	 * get next event from the queue 
 	 * @return - available event or Event::EV_NONE
 	 */
-	virtual Event get() = 0;
+	Event get() {
+		EventRecord r;
+		return get(r) ? r.type : Event::EV_NONE;
+	}
 	/**
 	 * put event into the queue
 	 * @param[in] e - any event
+	 * @param[in] lane - where it goes, only one context may put into a lane
+	 */
+	void put(Event e, Lane lane = LANE_APP) {
+		put(e, 0, lane);
+	}
+	/**
+	 * put event with a payload into the queue, e.g. EV_CUSTOM with a board cell
+	 * @param[in] e - any event
+	 * @param[in] data - EventRecord::data
+	 * @param[in] lane - where it goes, only one context may put into a lane
+	 */
+	void put(Event e, uint8_t data, Lane lane = LANE_APP) {
+		EventRecord r {e, data, uint16_t(HAL_GetTick())};
+		switch (lane) {
+		case LANE_INPUT:
+			input.put(r);
+			break;
+		case LANE_TIMER:
+			timer.put(r);
+			break;
+		default:
+			app.put(r);
+			break;
+		}
+	}
+	/**
+	 * @brief events lost on overflow so far, all lanes together
 	 */
-	virtual void put(Event e) = 0;
+	uint32_t getDropped() const {
+		return app.getDropped() + input.getDropped() + timer.getDropped();
+	}
+protected:
+	SpscQueue<EventRecord, 4> app;		///< LANE_APP
+	SpscQueue<EventRecord, 8> input;	///< LANE_INPUT, room for a burst of keys
+	SpscQueue<EventRecord, 8> timer;	///< LANE_TIMER, room for the timers expiring together
 };
 
 /**
@@ -81,6 +182,47 @@ public:
 	virtual Event handleEvent(Event event) = 0;
 };
 
+/**
+ * @brief A timed sequence of steps, such as a button press feedback
+ *
+ * Program runs the steps between the events while the CPU sleeps
+ * between SysTick interrupts. Every step should repaint and push
+ * only the screen part it touches, @see AF_PCD8544_HAL::displayRect()
+ */
+class Animation {
+public:
+	/**
+	 * @brief do the next step
+	 * @param n - step number, starting from 0
+	 * @return ms to the next step, 0 when the animation is over
+	 */
+	virtual uint16_t step(uint8_t n) = 0;
+	/**
+	 * @brief jump to the final state right away
+	 *
+	 * Invoked instead of the remaining steps when a key skips the animation.
+	 * The key is dropped if a new main window is shown meanwhile
+	 */
+	virtual void finish() = 0;
+};
+
+/**
+ * @brief software timer, @see Program::startTimer()
+ *
+ * Puts its event into the queue on expiry, so a program may keep
+ * as many independent timeouts as it likes, e.g. cursor blink and AI time budget
+ */
+struct Timer: public WheelTimer {
+	Event event;	///< what to put on expiry
+	uint8_t data;	///< EventRecord::data to put along
+	/**
+	 * @param e - the event to put on expiry
+	 * @param d - its payload
+	 */
+	explicit Timer(Event e = Event::EV_TIMER, uint8_t d = 0):event(e),data(d) {
+	}
+};
+
 /**
  * @brief An abstract program class to work on our hardware.
  *
@@ -91,22 +233,357 @@ public:
  */
 class Program: public EventHandler {
 protected:
-	AF_PCD8544_HAL display;	///< Nokia LCD display
+	AF_PCD8544_HAL &display;	///< Nokia LCD display, the one all programs share
 	int refresh;			///< for how long to sleep on no events
+	Timer refreshTimer;		///< EV_TIMER every refresh period with no events
 	Program();				///< you cannot instantiate the based program class, thus protected constructor
+	/**
+	 * @brief constructor of a program which doesn't start on its own
+	 * @param primary - false to leave the main program as is, @see switchTo()
+	 */
+	explicit Program(bool primary);
+	Program *caller;		///< the program which passed the control to us, if any
+	bool resuming;			///< the program we switched to came back(), resume() instead of init()
+	EventRecord current;	///< the event being handled
+	EventRecord heldKey;	///< a key that finished the animations, waits for the events they put meanwhile
+	uint8_t heldShown;		///< windowsShown when heldKey was pressed
+	/**
+	 * @brief take the next event from the queue into current
+	 * @return its type or Event::EV_NONE
+	 */
+	Event nextEvent() {
+		if (heldKey.type != Event::EV_NONE && events->empty(EventQueue::LANE_APP)) {
+			EventRecord held = heldKey;
+			heldKey.type = Event::EV_NONE;
+			// the events it waited for passed the focus on, it was meant for the window before
+			if (heldShown == windowsShown) {
+				current = held;
+				return current.type;
+			}
+			noteHandled();
+		}
+		if (!events->get(current))
+			return Event::EV_NONE;
+		if (isKey(current.type) && !current.data)
+			noteInput();
+		return current.type;
+	}
+	/** @brief learn how often the keys are pressed, for idle(), and trace the press latency */
+	void noteInput();
+	/** @brief the key event is handled, for getLatency() */
+	static void noteHandled();
+	/** @brief how many animations may run at once */
+	static constexpr int MAX_ANIMATIONS = 4;
+	/**
+	 * @brief running animation
+	 */
+	struct Running {
+		Animation *animation;	///< nullptr for a free slot
+		uint32_t due;			///< HAL tick of the next step
+		uint8_t n;				///< next step number
+	};
+	Running animations[MAX_ANIMATIONS];	///< what's animated now
+	/** @brief do the animation steps which are due */
+	void runAnimations();
+	/** @brief HAL tick of the nearest animation step */
+	uint32_t nextAnimationStep() const;
+	/** @brief put the events of the expired timers into the queue */
+	static void runTimers();
+	/**
+	 * @brief one slice of every ready task
+	 * @return false if none was ready, so the CPU may sleep
+	 */
+	static bool runTasks();
+	/** @brief put CPU into regular sleep mode until the next interrupt, SysTick included */
+	void tickSleep();
+	bool invalid;			///< render() is due once the events are drained
+	uint8_t windowsShown;	///< main windows shown so far, a key which skipped the animations is for the one it was pressed at
+	/**
+	 * @brief paint the screen and push it
+	 *
+	 * Invoked by execute() once all pending events are handled, if anything
+	 * invalidated the screen while handling them
+	 */
+	virtual void render() {
+	}
+	/**
+	 * @brief advance the game by one tick in fixed-timestep mode
+	 *
+	 * Invoked setTickRate() times a second after the pending events are
+	 * handled. Several updates in a row catch up after a slow frame,
+	 * then render() follows
+	 */
+	virtual void update() {
+	}
+	uint16_t tickPeriod;	///< ms between update() calls, 0 in event mode
+	uint8_t maxCatchUp;		///< the most update() calls per frame
+	uint32_t nextUpdate;	///< HAL tick of the next update()
+	uint32_t frameIdle;		///< us slept since the last frame
+	uint32_t frameSpi;		///< us of the frames sent, all together at the last frame
+	/**
+	 * @brief the nearest of the animation step, fixed tick, timer expiry and task wakeup
+	 */
+	uint32_t nextDeadline();
+	/**
+	 * @brief fixed-timestep mode step when no events are pending
+	 *
+	 * Either updates and renders the frame or sleeps till the next tick
+	 */
+	void fixedStep();
+	/**
+	 * @brief sleep till nextDeadline() in the mode the idle length pays for
+	 *
+	 * The idle is expected to last till the deadline, or the usual gap
+	 * between the keys while they are being pressed. STOP is chosen for
+	 * the long ones while no frame is being sent, unless its recent wakeups
+	 * exceed setWakeLatency() on average. Then it's tried once in a while
+	 * to see if they got faster
+	 */
+	void idle();
+	/** @brief start of execute(): init(), or resume() when the control came back() */
+	void enter();
 public:
 	/** @brief to be used by current program to pass the control to another program */
 	static void setMainProgram(Program *p);
+	/**
+	 * @brief pass the control to another program, which may come back to its caller
+	 *
+	 * The other program starts over with its init() once we return from execute()
+	 * @return Event::EV_CLOSE to be returned from handleEvent()
+	 */
+	Event switchTo(Program *p);
+	/**
+	 * @brief pass the control back to the program which switched to us
+	 *
+	 * The caller goes on with resume() where it left, not with init()
+	 * @return Event::EV_CLOSE to be returned from handleEvent()
+	 */
+	Event back();
 	/** @brief you can use custom initialization in your subclassed program, but don't forget to call master init() */
 	virtual void init();
-	/** @brief put CPU into STOP sleep mode until key pressed or time-out - best energy efficiency with slow wakeup */
+	/**
+	 * @brief the control came back(), the screen shows what the other program left
+	 *
+	 * Restarts the refresh timer and asks for render(). Yours may repaint
+	 * right away instead, then restart the timer with setRefresh(), @see WProgram::resume()
+	 */
+	virtual void resume();
+	/**
+	 * @brief sleep until the HAL tick reaches the deadline or an interrupt comes
+	 *
+	 * Tickless: SysTick is suspended and the RTC wakeup timer is armed for the
+	 * deadline with 0.4ms resolution, the longest sleep is ~26s. The HAL tick
+	 * is advanced by the time slept afterwards, measured by the RTC calendar
+	 * to 3.2ms of the LSI if an interrupt came first. The timer stays armed for the same
+	 * deadline, so the next call doesn't arm it again.
+	 * SysTick keeps running while the buttons are sampled or grayscale planes cycle
+	 * @param deadline - HAL tick to wake up at
+	 * @param stop - STOP mode instead of SLEEP - better efficiency with slower wakeup
+	 */
+	void sleepUntil(uint32_t deadline, bool stop = false);
+	/**
+	 * @brief system clock profiles, the display SPI stays at 4-4.5MHz on any of them
+	 */
+	enum ClockProfile: uint8_t {
+		CLOCK_8MHZ = 0,	///< HSE straight with the PLL off, for waiting on keys and light UI work
+		CLOCK_36MHZ,	///< HSE/2 x9 PLL
+		CLOCK_72MHZ,	///< HSE x9 PLL as CubeMX sets it up, for AI search and heavy rendering
+		CLOCK_PROFILES
+	};
+	/**
+	 * @brief switch the system clock
+	 *
+	 * Waits for the display transfer, then sets the flash latency, the bus
+	 * dividers, the SPI prescaler and SysTick for the new clock. Raising it
+	 * to the PLL takes ~0.2ms for the lock. Wakeup from STOP mode restores
+	 * the same profile. The CPU cycle figures in the stats of the tasks and
+	 * the display are of the clock in use while they were counted, compare
+	 * them within one profile. getFrameStats() and the latency are in us
+	 * @param p - the profile, the boot one is CLOCK_72MHZ
+	 */
+	static void setClock(ClockProfile p);
+	/** @brief the current system clock profile */
+	static ClockProfile getClock();
+	/**
+	 * @brief time spent on each clock profile
+	 */
+	struct ClockStats {
+		uint32_t switches;			///< setClock() calls which changed the profile
+		uint32_t ms[CLOCK_PROFILES];	///< HAL ticks on each profile, sleeping included
+	};
+	/** @brief how long the CPU ran at each speed so far */
+	static ClockStats getClockStats();
+	/**
+	 * @brief full speed while in scope, e.g. around the AI search
+	 *
+	 * Restores the previous profile when destroyed
+	 */
+	class ClockBoost {
+		ClockProfile saved;	///< to restore
+	public:
+		/** @param p - the profile for the scope */
+		explicit ClockBoost(ClockProfile p = CLOCK_72MHZ):saved(getClock()) {
+			setClock(p);
+		}
+		~ClockBoost() {
+			setClock(saved);
+		}
+	};
+	/**
+	 * @brief the longest wakeup the idle() governor may put up with
+	 *
+	 * It delays a key that wakes the CPU up. Defaults to 4ms, the HSE
+	 * start-up alone takes ~2ms of the STOP wakeup
+	 * @param us - ceiling in microseconds, 0 never to choose STOP mode
+	 */
+	static void setWakeLatency(uint16_t us);
+	/** @brief put CPU into STOP sleep mode until key pressed or time-out with EV_TIMER - best energy efficiency with slow wakeup */
 	void stopSleep(int sec);
-	/** @brief put CPU into regular sleep mode until key pressed or time-out - medium efficiency with fast wakeup */
+	/** @brief put CPU into regular sleep mode until key pressed or time-out with EV_TIMER - medium efficiency with fast wakeup */
 	void sleepSleep(int sec);
+	/**
+	 * @brief tickless idle counters
+	 */
+	struct IdleStats {
+		uint32_t sleeps;	///< tickless sleeps
+		uint32_t early;		///< of them ended by an interrupt before the deadline
+		uint32_t rearms;	///< RTC wakeup timer programmings
+		uint32_t sleptMs;	///< HAL ticks made up after the sleeps
+		uint32_t stops;		///< of the sleeps in STOP mode, the rest in SLEEP
+		uint32_t stopMs;	///< of sleptMs in STOP mode
+		uint16_t sleepWakeUs;	///< the longest SLEEP wakeup, WFI to the interrupts enabled
+		uint16_t stopWakeUs;	///< the longest STOP wakeup, with the clocks and RTC restored
+		uint16_t stopWakeAvgUs;	///< recent STOP wakeups on average, idle() goes by it
+	};
+	/** @brief how the CPU slept so far */
+	const IdleStats &getIdleStats() const {
+		return idleStats;
+	}
+	/**
+	 * @brief input-to-photon latency of the key presses so far
+	 *
+	 * One press at a time is followed from the button interrupt to the end
+	 * of the first frame transfer started after it was taken from the queue.
+	 * The wakeup from the idle is before the interrupt, @see getIdleStats()
+	 */
+	static const LatencyTrace &getLatency();
+	/** @brief invoked every ms from SysTick interrupt while the HAL tick runs */
+	void tick();
+	/**
+	 * @brief auto-repeat of the arrow keys while held
+	 *
+	 * The repeats come as the key events with EventRecord::data counting them.
+	 * Defaults to 400ms and 100ms
+	 * @param delay - ms from the press to the first repeat, 0 to turn it off
+	 * @param period - ms between the repeats
+	 */
+	static void setKeyRepeat(uint16_t delay, uint16_t period);
+	/**
+	 * @brief start or restart the timer
+	 *
+	 * Its event comes through the queue like any other, with 1ms resolution.
+	 * The timers are shared by all programs, cancel yours before switchTo()
+	 * @param t - the timer, must stay alive until it expires or is cancelled
+	 * @param ms - delay before the expiry
+	 * @param period - ms between the expiries afterwards, 0 - one-shot
+	 */
+	static void startTimer(Timer &t, uint32_t ms, uint32_t period = 0);
+	/** @brief stop the timer if it's running */
+	static void cancelTimer(Timer &t);
+	/** @brief how many background tasks may run at once */
+	static constexpr int MAX_TASKS = 4;
+	/**
+	 * @brief run the task in the background, from its beginning
+	 *
+	 * A slice of every ready task runs between the events before the CPU
+	 * sleeps, the sleeping ones wake it up. The tasks are shared by all
+	 * programs, kill yours before switchTo()
+	 * @param t - the task, must stay alive until it's done or killed
+	 * @return false if MAX_TASKS are running already
+	 */
+	static bool spawn(Task &t);
+	/** @brief stop the task */
+	static void kill(Task &t);
+	/**
+	 * @brief the full record of the event passed to handleEvent()
+	 *
+	 * Tells when it was put and its payload
+	 */
+	const EventRecord &currentEvent() const {
+		return current;
+	}
+	/**
+	 * @brief start the animation
+	 *
+	 * Restarts it if already running. When no slot is free the animation
+	 * is finished right away
+	 * @param a - the animation, must stay alive until it's over
+	 * @param delay - ms before the first step
+	 */
+	void animate(Animation *a, uint16_t delay = 0);
+	/** @brief is anything being animated */
+	bool animating() const;
+	/** @brief finish all animations at once */
+	void skipAnimations();
+	/**
+	 * @brief the screen needs render()
+	 *
+	 * Use it instead of pushing the screen from handleEvent(), so a burst
+	 * of events costs one frame
+	 */
+	void invalidate();
+	/**
+	 * @brief how much render coalescing saves
+	 */
+	struct RenderStats {
+		uint32_t rendered;		///< render() invocations
+		uint32_t coalesced;		///< invalidate() calls absorbed by an already pending render()
+	};
+	/** @brief frames rendered and skipped so far */
+	const RenderStats &getRenderStats() const {
+		return renderStats;
+	}
+	/**
+	 * @brief switch to fixed-timestep mode, or back to event mode
+	 *
+	 * The period is 1000/hz ms rounded down, e.g. 20, 25 or 50Hz are exact.
+	 * The CPU sleeps between ticks with SysTick running
+	 * @param hz - update() rate, 0 for event mode
+	 * @param catchUp - the most update() calls per frame after a slow one,
+	 * the ticks beyond it are dropped and counted as missed
+	 */
+	void setTickRate(uint8_t hz, uint8_t catchUp = 3);
+	/**
+	 * @brief fixed-timestep mode counters and the last frame budget
+	 *
+	 * The time figures are for the last frame: from the previous frame
+	 * start to this one. They are microseconds of the HAL tick, so they
+	 * add up whatever setClock() was in use. Compare their sum to 1000000/hz
+	 */
+	struct FrameStats {
+		uint32_t frames;		///< frames rendered
+		uint32_t updates;		///< update() invocations
+		uint32_t late;			///< frames that needed catch-up updates
+		uint32_t missed;		///< ticks dropped beyond the catch-up limit
+		uint32_t updateUs;		///< us in update() of the last frame
+		uint32_t renderUs;		///< us in render() of the last frame
+		uint32_t spiUs;			///< us the frames were being sent during the last frame
+		uint32_t idleUs;		///< us slept during the last frame
+	};
+	/** @brief how well the game keeps up with its tick rate */
+	const FrameStats &getFrameStats() const {
+		return frameStats;
+	}
 	/**
 	 * @brief run event handling loop
 	 *
 	 * Simply get next event from the queue and invoke handleEvent() on it.
+	 * Expired timers put their events first, background tasks run
+	 * when there are no events and nothing to render.
+	 * Animations run between the events, and a key pressed while they run
+	 * finishes them, then it's handled after the events they put on finishing.
+	 * In fixed-timestep mode update() and render() run at the tick rate
+	 * instead of sleeping for the refresh period.
 	 * if you want you can redefine processing event loop entirerly
 	 */
 	virtual void execute();
@@ -114,6 +591,10 @@ public:
 	void setRefresh(int r);
 	/** @brief entry point from C code */
 	friend void ::exec();
+protected:
+	RenderStats renderStats;	///< render coalescing counters
+	FrameStats frameStats;		///< fixed-timestep counters
+	IdleStats idleStats;		///< tickless idle counters
 };
 
 /**
@@ -125,8 +606,21 @@ class Window: public EventHandler {
 public:
 	/**
 	 * @brief display the window content. @see WProgram
+	 *
+	 * Invoked when the window gets the focus and on WProgram render()
 	 */
 	virtual void draw() = 0;
+	/**
+	 * @brief paint the static part of the window
+	 *
+	 * Invoked once when the window gets the focus. WProgram keeps the picture
+	 * as the display background layer, so draw() may only compose() it in
+	 * the regions it marks dirty instead of painting the static part again
+	 * @return false if the window has no static part
+	 */
+	virtual bool drawStatic() {
+		return false;
+	}
 };
 
 /**
@@ -141,4 +635,70 @@ public:
 	void setMainWindow(Window *w);
 	/** pass the event to the handleEvent() of the main window */
 	virtual Event handleEvent(Event event) override;
+	/** draw() the main window */
+	virtual void render() override;
+	/** paint the main window again */
+	virtual void resume() override;
+};
+
+/**
+ * @brief WProgram with a closed set of windows Ws in one shared storage
+ *
+ * The windows are dispatched statically by WindowSet, handleEvent() and
+ * draw() inline into a switch. They take the size of the largest one, as
+ * only the main window exists, constructed anew every time it's shown.
+ * Keep what must outlive it in the program. WProgram stays for windows
+ * which are Animation too or otherwise need their virtual calls.
+ * Unused by the programs in the tree so far, vgame-host runs it against WProgram
+ */
+template<typename... Ws>
+class SWProgram: public Program {
+protected:
+	WindowSet<Ws...> windows;	///< the main window is the active one
+	SWProgram() {
+	}
+	/** @brief constructor of a program which doesn't start on its own */
+	explicit SWProgram(bool primary):Program(primary) {
+	}
+	/** @brief paint the window which just got the focus, the same as WProgram::setMainWindow() */
+	void showMain() {
+		windowsShown++;
+		display.setBackground(nullptr);
+#if PCD8544_LAYER
+		if (windows.drawStatic())
+			display.captureBackground();
+#endif
+		windows.draw();
+	}
+public:
+	/**
+	 * @brief pass the focus to window W
+	 *
+	 * From the main window's handleEvent() it takes effect once that returns
+	 */
+	template<typename W>
+	void setMainWindow() {
+		if (windows.template show<W>())
+			showMain();
+	}
+	/** pass the event to the handleEvent() of the main window */
+	virtual Event handleEvent(Event event) override {
+		Event r = windows.handleEvent(event);
+		if (windows.commit())
+			showMain();
+		return r;
+	}
+	/** draw() the main window */
+	virtual void render() override {
+		windows.draw();
+	}
+	/** paint the main window again, the same as WProgram::resume() */
+	virtual void resume() override {
+		setRefresh(refresh);
+		invalid = false;
+		display.clearDisplay();
+		showMain();
+	}
 };
+
+#endif
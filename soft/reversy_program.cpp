@@ -7,6 +7,8 @@
  */
 
 #include "program.h"
+#include "widgets.h"
+#include "life_program.h"
 
 /*
  * enable AUTOTEST if we want to start with the Autotest window
@@ -33,6 +35,19 @@ lltoan(char *out, long long i, int n) {
 	return(out + n);
 }
 
+/**
+ * @brief START button of the splash window
+ */
+static constexpr Button startButton {"START", LCDWIDTH/2, LCDHEIGHT/4*3};
+/**
+ * @brief hint of the splash window how to get to Life
+ */
+static constexpr Label lifeLabel {"UP - Life", LCDWIDTH/2, LCDHEIGHT/8*3};
+/**
+ * @brief Again button of the game over window
+ */
+static constexpr Button againButton {"Again", LCDWIDTH/2, LCDHEIGHT/4*3};
+
 /**
  * @brief A game of reversy program
  *
@@ -65,51 +80,49 @@ protected:
 	 * Our splash window simply displays about message
 	 * and offers to start the game
 	 */
-	class StartWindow: public MyWindow {
-	protected:
-		char *label; // cannot be const due to stupid Adafruit lib
-		Adafruit_GFX_Button startButton; ///< GUI screen button
+	class StartWindow: public MyWindow, public Animation {
 	public:
 		/**
-		 * @brief initialize a window and START button
-		 */
-		StartWindow():MyWindow(),label((char*)"START") {
-			int16_t x, y;
-			uint16_t w, h;
-			program.display.getTextBounds(label, 0, 0, &x, &y, &w, &h);
-			startButton.initButton(&program.display,
-								   program.display.width()/2,
-								   program.display.height()/4*3,
-								   w+8,
-								   h+4,
-								   1,
-								   0,
-								   BLACK,
-								   label,
-								   1);
-		}
-		/**
-		 * @brief proceed to Game window on KEY_ENTER event
+		 * @brief proceed to Game window on KEY_ENTER event, to Life program on KEY_UP
 		 */
 		virtual Event handleEvent(Event event) override {
 			switch(event) {
 			case Event::EV_KEY_ENTER:
-				startButton.drawButton(true);
-				program.display.display();
-				HAL_Delay(300);
-				program.setMainWindow(&program.gameWindow);
+				program.animate(this);
 				break;
+			case Event::EV_KEY_UP:
+				return program.switchTo(&lifeProgram);
 			default:
 				break;
 			}
 			return Event::EV_NONE;
 		}
+		/**
+		 * @brief flash the screen as the press feedback
+		 */
+		virtual uint16_t step(uint8_t n) override {
+			if (n == 0) {
+				program.display.setEffect(AF_PCD8544_HAL::EFFECT_INVERT);
+				return press_ms;
+			}
+			finish();
+			return 0;
+		}
+		/**
+		 * @brief start the game
+		 */
+		virtual void finish() override {
+			Program::ClockBoost boost;
+			program.display.setEffect(AF_PCD8544_HAL::EFFECT_NORMAL);
+			program.setMainWindow(&program.gameWindow);
+		}
 		/**
 		 * @brief Display our staring message and on-screen START button
 		 */
 		virtual void draw() override {
 			program.display.print("Reversy v0.9");
-			startButton.drawButton();
+			lifeLabel.draw(program.display);
+			startButton.draw(program.display);
 			program.display.display();
 		};
 	};
@@ -121,8 +134,35 @@ protected:
 	 * and its screen for drawing. It updates the cursor coordinates and
 	 * invokes player vs computer reversy library
 	 */
-	class GameWindow: public MyWindow {
+	class GameWindow: public MyWindow, public Animation {
 	protected:
+		/**
+		 * @brief what GameWindow animates now
+		 */
+		enum Phase {
+			FLIP_PLAYER,	///< the chips turned by the player
+			FLIP_MACHINE,	///< the chips turned by the computer
+			GAME_OVER		///< blinking final board
+		};
+		Phase phase;		///< what step() does
+		GAME_STATE before;	///< the board before the turn being animated
+		/**
+		 * Paint one chip sprite
+		 * @param r - row number
+		 * @param c - column number
+		 * @param chip - the sprite, [cell_ysz-2][cell_xsz-2] array, which is not declared yet
+		 */
+		template<typename Sprite>
+		void drawSprite(int r, int c, const Sprite &chip) {
+			int px = cell_xsz * c + 1;
+			int py = cell_ysz * r + 1;
+			for (int y=0; y<cell_ysz-2; y++)
+				for (int x=0; x<cell_xsz-2; x++)
+					if (chip[y][x] != 0)
+						program.display.drawPixel(px+x, py+y, BLACK);
+					else
+						program.display.drawPixel(px+x, py+y, WHITE);
+		}
 		/**
 		 * Paint one chip
 		 * @param r - row number
@@ -132,28 +172,18 @@ protected:
 		 * @param[out] nBlack - will be incremented if the color is black
 		 */
 		void drawChip(int r, int c, CHIP_COLOR color, int &nWhite, int &nBlack) {
-			int px = cell_xsz * c + 1;
-			int py = cell_ysz * r + 1;
-			if (color == COLOR_VACANT) {
-				for (int y=0; y<cell_ysz-2; y++)
-					for (int x=0; x<cell_xsz-2; x++)
-						program.display.drawPixel(px+x, py+y, WHITE);
-			} else {
-				const unsigned char (&chip)[cell_ysz-2][cell_xsz-2] = (color == COLOR_POS)?whiteChip:blackChip;
-				switch (color) {
-				case COLOR_POS:
-					nWhite++;
-					break;
-				case COLOR_NEG:
-					nBlack++;
-					break;
-				}
-				for (int y=0; y<cell_ysz-2; y++)
-					for (int x=0; x<cell_xsz-2; x++)
-						if (chip[y][x] != 0)
-							program.display.drawPixel(px+x, py+y, BLACK);
-						else
-							program.display.drawPixel(px+x, py+y, WHITE);
+			switch (color) {
+			case COLOR_POS:
+				nWhite++;
+				drawSprite(r, c, whiteChip);
+				break;
+			case COLOR_NEG:
+				nBlack++;
+				drawSprite(r, c, blackChip);
+				break;
+			default:
+				drawSprite(r, c, noChip);
+				break;
 			}
 		}
 		/**
@@ -191,11 +221,9 @@ protected:
 			char sb[3];
 			*(lltoan(sw, nWhite, 2)) = 0;
 			*(lltoan(sb, nBlack, 2)) = 0;
-			int16_t x, y;
-			uint16_t w, h;
-			program.display.getTextBounds(sw, 0, 0, &x, &y, &w, &h);
-			x = (board_dim*cell_xsz)+(program.display.width()-(board_dim*cell_xsz)-w)/2;
-			y = (program.display.height()-h*3)/2;
+			int16_t h = FONT_HEIGHT;
+			int16_t x = (board_dim*cell_xsz)+(LCDWIDTH-(board_dim*cell_xsz)-textWidth(sw))/2;
+			int16_t y = (LCDHEIGHT-h*3)/2;
 			program.display.setCursor(x, y);
 			program.display.setTextColor(BLACK, WHITE);
 			program.display.print(sw);
@@ -207,7 +235,13 @@ protected:
 		 * @brief Paint the grid, all chips and score and push the image to the screen
 		 */
 		void redrawBoard() {
+#if PCD8544_LAYER
+			// the grid is our background layer
+			program.display.markDirty(0, 0, board_xsz+1, board_ysz+1);
+			program.display.compose();
+#else
 			drawGrid();
+#endif
 			int nWhite = 0;
 			int nBlack = 0;
 			for (int r=0; r<board_dim; r++)
@@ -217,37 +251,92 @@ protected:
 			drawScore(nWhite, nBlack);
 			program.display.display();
 		}
+		/**
+		 * @brief animate the chips changed since the before board
+		 * @param p - whose turn it was
+		 */
+		void startFlip(Phase p) {
+			phase = p;
+			program.animate(this);
+		}
+		/**
+		 * @brief paint the turned chips edge-on and the new ones as they are
+		 *
+		 * Pushes only the board part with the changes
+		 */
+		void drawFlip() {
+			int c0 = board_dim, r0 = board_dim, c1 = -1, r1 = -1;
+			int nWhite = 0;
+			int nBlack = 0;
+			for (int r=0; r<board_dim; r++) {
+				for (int c=0; c<board_dim; c++) {
+					CHIP_COLOR was = before.b[c][r];
+					CHIP_COLOR is = program.board.b[c][r];
+					if (was == is)
+						continue;
+					if (was == COLOR_VACANT)
+						drawChip(r, c, is, nWhite, nBlack);
+					else
+						drawSprite(r, c, flipChip);
+					c0 = (c < c0) ? c : c0;
+					r0 = (r < r0) ? r : r0;
+					c1 = (c > c1) ? c : c1;
+					r1 = (r > r1) ? r : r1;
+				}
+			}
+			if (c1 >= 0)
+				program.display.displayRect(c0*cell_xsz, r0*cell_ysz, (c1-c0+1)*cell_xsz, (r1-r0+1)*cell_ysz);
+		}
 		/**
 		 * @brief Executes when user pressed ENTER.
 		 *
-		 * Make a turn by player at the current cursor position
-		 * and immediately perform the turn by the computer
-		 * Check game over condition
+		 * Make a turn by player at the current cursor position.
+		 * The computer turns after the chips flip
 		 */
 		bool mkTurn() {
 			GAME_TURN turn = {program.mycolor, program.cursorX, program.cursorY};
 			if (validate_turn(&program.board, &turn) == E_OK) {
+				before = program.board;
 				make_turn(&program.board, &turn);
-				redrawBoard();
-				GAME_TURN availableTurns[board_dim*board_dim];
-				GAME_TURN machineTurn;
-				int n;
-				while ((n=make_turn_list(availableTurns, &program.board, ALTER_COLOR(program.mycolor)))>0) {
-					find_best_turn(&machineTurn, &program.board, ALTER_COLOR(program.mycolor), program.level);
-					make_turn(&program.board, &machineTurn);
-					if ((n=make_turn_list(availableTurns, &program.board, program.mycolor))>0)
-						break;
-					redrawBoard();
-				}
-				if (n<=0)
-					program.gameIsOver = true;
+				startFlip(FLIP_PLAYER);
 				return true;
 			} else {
 				return false;
 			}
 		}
+		/**
+		 * @brief Perform the turn by the computer
+		 *
+		 * The computer keeps turning while the player has no turn.
+		 * Check game over condition
+		 */
+		void machineTurn() {
+			before = program.board;
+			GAME_TURN availableTurns[board_dim*board_dim];
+			GAME_TURN machineTurn;
+			int n;
+			// the search and the frames are the heavy work, the rest runs at the low clock
+			Program::ClockBoost boost;
+			while ((n=make_turn_list(availableTurns, &program.board, ALTER_COLOR(program.mycolor)))>0) {
+				find_best_turn(&machineTurn, &program.board, ALTER_COLOR(program.mycolor), program.level);
+				make_turn(&program.board, &machineTurn);
+				if ((n=make_turn_list(availableTurns, &program.board, program.mycolor))>0)
+					break;
+			}
+			if (n<=0)
+				program.gameIsOver = true;
+			startFlip(FLIP_MACHINE);
+		}
 
 	public:
+		/**
+		 * @brief The grid never changes
+		 */
+		virtual bool drawStatic() override {
+			program.display.clearDisplay();
+			drawGrid();
+			return true;
+		}
 		/**
 		 * @brief Draw entire game board and push it to the screen
 		 */
@@ -255,6 +344,49 @@ protected:
 			program.display.clearDisplay();
 			redrawBoard();
 		};
+		/**
+		 * @brief next frame of the flip or game over blinking
+		 */
+		virtual uint16_t step(uint8_t n) override {
+			if (phase == GAME_OVER) {
+				if (n < 2*game_over_blinks) {
+					program.display.setEffect((n%2 == 0) ? AF_PCD8544_HAL::EFFECT_INVERT : AF_PCD8544_HAL::EFFECT_NORMAL);
+					return game_over_ms/(2*game_over_blinks);
+				}
+			} else if (n == 0) {
+				Program::ClockBoost boost;
+				drawFlip();
+				return flip_ms;
+			}
+			finish();
+			return 0;
+		}
+		/**
+		 * @brief the final board after the flip or the game result after blinking
+		 */
+		virtual void finish() override {
+			Program::ClockBoost boost;
+			switch (phase) {
+			case FLIP_PLAYER:
+				redrawBoard();
+				events->put(EV_MACHINE_TURN);
+				break;
+			case FLIP_MACHINE:
+				redrawBoard();
+				if (program.gameIsOver) {
+					phase = GAME_OVER;
+					program.animate(this);
+				}
+				break;
+			case GAME_OVER:
+				// show the result at once
+				program.display.blank();
+				program.againWindow.updateMessage();
+				program.setMainWindow(&program.againWindow);
+				program.display.reveal();
+				break;
+			}
+		}
 		/**
 		 * @brief Handle user keys by moving cursor on arrows and making a turn on enter
 		 */
@@ -275,18 +407,16 @@ protected:
 				dy = 1;
 				break;
 			case Event::EV_KEY_ENTER:
-				if (!mkTurn())
-					return rc;
-				break;
+				mkTurn();
+				return rc;
+			case EV_MACHINE_TURN:
+				machineTurn();
+				return rc;
 			default:
 				return rc;
 			}
-			if (program.gameIsOver) {
-				HAL_Delay(3000);
-				program.againWindow.updateMessage();
-				program.setMainWindow(&program.againWindow);
+			if (program.gameIsOver)
 				return rc;
-			}
 			if ((dx != 0 || dy != 0) &&
 				program.cursorX+dx >= 0 && program.cursorX+dx < board_dim &&
 				program.cursorY+dy >= 0 && program.cursorY+dy < board_dim)
@@ -295,7 +425,7 @@ protected:
 				program.cursorX += dx;
 				program.cursorY += dy;
 			}
-			redrawBoard();
+			program.invalidate();
 			return rc;
 		}
 	};
@@ -320,6 +450,7 @@ protected:
 				GAME_TURN availableTurns[board_dim*board_dim];
 				GAME_TURN machineTurn;
 				int n;
+				Program::ClockBoost boost;
 				while ((n=make_turn_list(availableTurns, &program.board, program.mycolor))>0) {
 					find_best_turn(&machineTurn, &program.board, program.mycolor, program.level);
 					make_turn(&program.board, &machineTurn);
@@ -328,10 +459,13 @@ protected:
 					redrawBoard();
 				}
 				redrawBoard();
-				if (n<=0)
+				if (n<=0) {
 					program.gameIsOver = true;
-				else
+					phase = GAME_OVER;
+					program.animate(this);
+				} else {
 					events->put(event);
+				}
 				program.mycolor = ALTER_COLOR(program.mycolor);
 			}
 			return GameWindow::handleEvent(event);
@@ -346,26 +480,11 @@ protected:
 	 * AgainWindow displayed after the game is over
 	 * and shows the score and offers another round
 	 */
-	class AgainWindow: public MyWindow {
+	class AgainWindow: public MyWindow, public Animation {
 	protected:
 		const char *message;			///< game result
-		char *label; // cannot be const due to stupid Adafruit lib
-		Adafruit_GFX_Button againButton;	///< GUI screen button
 	public:
-		AgainWindow():MyWindow(),message((char*)""),label((char*)"Again") {
-			int16_t x, y;
-			uint16_t w, h;
-			program.display.getTextBounds(label, 0, 0, &x, &y, &w, &h);
-			againButton.initButton(&program.display,
-								   program.display.width()/2,
-								   program.display.height()/4*3,
-								   w+8,
-								   h+4,
-								   1,
-								   0,
-								   BLACK,
-								   label,
-								   1);
+		AgainWindow():MyWindow(),message("") {
 		}
 		/**
 		 * @brief display until user presses enter
@@ -375,17 +494,33 @@ protected:
 		virtual Event handleEvent(Event event) override {
 			switch(event) {
 			case Event::EV_KEY_ENTER:
-				againButton.drawButton(true);
-				program.display.display();
-				HAL_Delay(300);
-				program.startNewGame();
-				program.setMainWindow(&program.gameWindow);
+				program.animate(this);
 				break;
 			default:
 				break;
 			}
 			return Event::EV_NONE;
 		}
+		/**
+		 * @brief flash the screen as the press feedback
+		 */
+		virtual uint16_t step(uint8_t n) override {
+			if (n == 0) {
+				program.display.setEffect(AF_PCD8544_HAL::EFFECT_INVERT);
+				return press_ms;
+			}
+			finish();
+			return 0;
+		}
+		/**
+		 * @brief start another round
+		 */
+		virtual void finish() override {
+			Program::ClockBoost boost;
+			program.display.setEffect(AF_PCD8544_HAL::EFFECT_NORMAL);
+			program.startNewGame();
+			program.setMainWindow(&program.gameWindow);
+		}
 		/**
 		 * @brief Select which message to display, WIN/LOSE/DRAW
 		 */
@@ -407,7 +542,7 @@ protected:
 			program.display.setCursor(0, 0);
 			program.display.setTextColor(BLACK, WHITE);
 			program.display.print(message);
-			againButton.drawButton();
+			againButton.draw(program.display);
 			program.display.display();
 		};
 	};
@@ -449,6 +584,34 @@ protected:
 	 * @brief width of entire board
 	 */
 	static constexpr int board_xsz = cell_xsz*board_dim-1;
+	/**
+	 * @brief the computer turns on this event after the player's chips flip
+	 */
+	static constexpr Event EV_MACHINE_TURN = Event::EV_CUSTOM;
+	/**
+	 * @brief how long the on-screen button press feedback lasts
+	 */
+	static constexpr uint16_t press_ms = 300;
+	/**
+	 * @brief how long the turned chips stay edge-on
+	 */
+	static constexpr uint16_t flip_ms = 150;
+	/**
+	 * @brief how many times the final board blinks
+	 */
+	static constexpr int game_over_blinks = 3;
+	/**
+	 * @brief how long the final board blinks
+	 */
+	static constexpr uint16_t game_over_ms = 3000;
+	/**
+	 * @brief Empty cell sprite
+	 */
+	static const unsigned char noChip[cell_ysz-2][cell_xsz-2];
+	/**
+	 * @brief Chip being turned sprite
+	 */
+	static const unsigned char flipChip[cell_ysz-2][cell_xsz-2];
 	/**
 	 * @brief White chip sprite
 	 */
@@ -499,6 +662,7 @@ public:
 	 */
 	virtual void init() override {
 		Program::init();
+		setClock(CLOCK_8MHZ);
 #ifdef AUTOTEST		
 		setMainWindow(&testGameWindow);
 		events->put(Event::EV_CUSTOM+1);
@@ -510,6 +674,20 @@ public:
 		mainWindow->draw();
 		level = 5;
 	}
+	/**
+	 * @brief draw the frame at full speed, sleep between them at the low clock
+	 */
+	virtual void render() override {
+		ClockBoost boost;
+		WProgram::render();
+	}
+	/**
+	 * @brief Back from Life, the game goes on at our clock
+	 */
+	virtual void resume() override {
+		setClock(CLOCK_8MHZ);
+		WProgram::resume();
+	}
 	/**
 	 * @brief Wipe out game board
 	 */
@@ -529,6 +707,19 @@ public:
 	
 };
 
+/**
+ * @brief Empty cell sprite
+ */
+const unsigned char MyProgram::noChip[cell_ysz-2][cell_xsz-2] = {
+};
+/**
+ * @brief Chip being turned sprite
+ */
+const unsigned char MyProgram::flipChip[cell_ysz-2][cell_xsz-2] = {
+	{0, 1, 1, 0},
+	{0, 1, 1, 0},
+	{0, 1, 1, 0},
+};
 /**
  * @brief White chip sprite
  */
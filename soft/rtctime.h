@@ -0,0 +1,51 @@
+/**
+ * @file
+ * @brief Time elapsed by the RTC calendar
+ *
+ * A calendar second is (PREDIV_A+1)*(PREDIV_S+1) RTCCLK periods, a real
+ * one only when the prescalers divide RTCCLK down to 1Hz. CubeMX sets
+ * 127 and 255 for the 40kHz LSI, so it lasts 0.8192s and the subsecond
+ * ticks are converted by the RTCCLK rate instead.
+ * Pure logic, the caller reads the registers
+ * @author Denis Kokarev
+ */
+#ifndef _RTCTIME_H
+#define _RTCTIME_H
+
+#include <cstdint>
+
+/**
+ * @brief RTC readings to milliseconds
+ */
+class RtcTime {
+public:
+	/**
+	 * @param prer - RTC PRER register, both prescalers
+	 * @param rtcclk - RTCCLK rate in Hz, e.g. LSI_VALUE
+	 */
+	RtcTime(uint32_t prer, uint32_t rtcclk):
+		asynch(((prer >> 16) & 0x7f) + 1), synch((prer & 0x7fff) + 1), hz(rtcclk) {
+	}
+	/**
+	 * @brief time of day in synchronous prescaler ticks
+	 * @param tr - RTC TR register
+	 * @param ssr - RTC SSR register, read before TR
+	 */
+	uint32_t ticks(uint32_t tr, uint32_t ssr) const {
+		uint32_t h = ((tr >> 20) & 0x3)*10 + ((tr >> 16) & 0xf);
+		uint32_t m = ((tr >> 12) & 0x7)*10 + ((tr >> 8) & 0xf);
+		uint32_t sec = ((tr >> 4) & 0x7)*10 + (tr & 0xf);
+		return (h*3600 + m*60 + sec)*synch + (synch - 1 - ssr);
+	}
+	/** @brief ms between two ticks() readings, midnight included */
+	uint32_t elapsedMs(uint32_t from, uint32_t to) const {
+		uint32_t day = 24*3600*synch;
+		return uint64_t((to + day - from) % day)*1000*asynch/hz;
+	}
+protected:
+	uint32_t asynch;	///< RTCCLK periods per synchronous tick
+	uint32_t synch;		///< synchronous ticks per calendar second
+	uint32_t hz;		///< RTCCLK rate
+};
+
+#endif
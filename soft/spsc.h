@@ -0,0 +1,76 @@
+/**
+ * @file
+ * @brief Lock-free single-producer single-consumer queue
+ *
+ * Safe to put() from one interrupt handler and get() from the main loop,
+ * or the other way around, without masking interrupts. The indices run
+ * freely and wrap by the power of two capacity mask, so all N slots hold
+ * data. Each index is written by one side only, and the release store
+ * of it publishes the slot to the other side
+ * @author Denis Kokarev
+ */
+#ifndef _SPSC_H
+#define _SPSC_H
+
+#include <cstdint>
+#include <atomic>
+
+/**
+ * @brief bounded queue of T with one writer and one reader
+ *
+ * Pure header with no hardware dependencies, all calls are inlined
+ * @tparam T - element type, copied in and out
+ * @tparam N - capacity, power of two up to 32768
+ */
+template<typename T, int N>
+class SpscQueue {
+	static_assert(N > 0 && N <= 32768 && (N & (N-1)) == 0, "SpscQueue capacity must be a power of two");
+protected:
+	T q[N];							///< the slots
+	std::atomic<uint16_t> head;		///< next slot to get, written by the consumer
+	std::atomic<uint16_t> tail;		///< next slot to put, written by the producer
+	std::atomic<uint32_t> dropped;	///< put() calls on the full queue, written by the producer
+public:
+	SpscQueue():head(0),tail(0),dropped(0) {
+	}
+	/**
+	 * @brief producer side, enqueue the element
+	 * @return false if the queue is full, the element is dropped and counted then
+	 */
+	bool put(const T &v) {
+		uint16_t t = tail.load(std::memory_order_relaxed);
+		if (uint16_t(t - head.load(std::memory_order_acquire)) == N) {
+			dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+			return false;
+		}
+		q[t & (N-1)] = v;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	/**
+	 * @brief consumer side, dequeue the oldest element
+	 * @return false if the queue is empty, v stays intact then
+	 */
+	bool get(T &v) {
+		uint16_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire))
+			return false;
+		v = q[h & (N-1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+	/**
+	 * @brief nothing to get, exact on the consumer side
+	 */
+	bool empty() const {
+		return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire);
+	}
+	/**
+	 * @brief number of elements dropped on overflow so far
+	 */
+	uint32_t getDropped() const {
+		return dropped.load(std::memory_order_relaxed);
+	}
+};
+
+#endif
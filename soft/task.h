@@ -0,0 +1,195 @@
+/**
+ * @file
+ * @brief Cooperative background tasks on stackless coroutines
+ *
+ * A Task is a protothread: run() is a switch over the line it stopped at,
+ * so it keeps no stack between the slices and its state lives in the
+ * object members. The tasks and their scheduler are statically allocated,
+ * Program runs a slice of every ready task between the events
+ *
+ * @code
+ * class Search: public Task {
+ *	int depth;
+ *	void run() override {
+ *		TASK_BEGIN();
+ *		for (depth=1; depth<8; depth++) {
+ *			searchDepth(depth);
+ *			TASK_YIELD();
+ *		}
+ *		TASK_END();
+ *	}
+ * };
+ * @endcode
+ * @author Denis Kokarev
+ */
+#ifndef _TASK_H
+#define _TASK_H
+
+#include <cstdint>
+#include "cycles.h"
+
+/** @brief start of Task::run() body */
+#define TASK_BEGIN() switch (resume) { case 0:
+/** @brief let the others run, continue here on the next slice */
+#define TASK_YIELD() do { resume = __LINE__; return; case __LINE__:; } while (0)
+/** @brief continue here once ms pass, the CPU may sleep meanwhile */
+#define TASK_SLEEP(ms) do { sleepFor(ms); resume = __LINE__; return; case __LINE__:; } while (0)
+/** @brief wait until the condition holds, checked once per scheduler pass, the CPU may sleep meanwhile */
+#define TASK_WAIT_UNTIL(cond) do { resume = __LINE__; case __LINE__: if (!(cond)) { state = WAITING; return; } state = READY; } while (0)
+/** @brief end of Task::run() body, the task is done */
+#define TASK_END() } finish()
+
+/**
+ * @brief background task, the task control block and its code in one
+ *
+ * Override run() with the body between TASK_BEGIN() and TASK_END().
+ * Local variables don't survive TASK_YIELD() and friends, use the members.
+ * There is no switch statement allowed around them either
+ */
+class Task {
+public:
+	/**
+	 * @brief what the scheduler does with the task
+	 */
+	enum State: uint8_t {
+		DONE = 0,	///< not spawned or finished
+		READY,		///< runs on the next slice
+		SLEEPING,	///< waits till wakeAt
+		WAITING,	///< polls its TASK_WAIT_UNTIL() condition, once per wakeup
+	};
+	/**
+	 * @brief where the CPU time goes
+	 *
+	 * In cycles of the clock each slice ran at, Program::setClock() may change it
+	 */
+	struct Stats {
+		uint32_t slices;	///< run() invocations
+		uint64_t cycles;	///< CPU cycles spent in run() altogether, 32 bits wrap in a minute at 72MHz
+		uint32_t maxCycles;	///< the longest slice, it delays the events that much
+	};
+	Task():resume(0),state(DONE),now(0),wakeAt(0),stats() {
+	}
+	/** @brief spawned and not done yet */
+	bool running() const {
+		return state != DONE;
+	}
+	/** @brief CPU time of the task so far */
+	const Stats &getStats() const {
+		return stats;
+	}
+protected:
+	/**
+	 * @brief one slice of the task, return soon to keep the keys responsive
+	 */
+	virtual void run() = 0;
+	/** @brief TASK_SLEEP() implementation */
+	void sleepFor(uint32_t ms) {
+		wakeAt = now + ms;
+		state = SLEEPING;
+	}
+	/** @brief TASK_END() implementation */
+	void finish() {
+		resume = 0;
+		state = DONE;
+	}
+	uint16_t resume;	///< line to continue at, 0 - from the beginning
+	State state;		///< scheduling state
+	uint32_t now;		///< HAL tick of the current slice
+	uint32_t wakeAt;	///< HAL tick to wake up at when SLEEPING
+	Stats stats;		///< CPU time counters
+	template<int N> friend class TaskScheduler;
+};
+
+/**
+ * @brief round-robin scheduler of up to N tasks
+ *
+ * Pure logic, the caller feeds it the time
+ */
+template<int N>
+class TaskScheduler {
+public:
+	TaskScheduler():tasks() {
+	}
+	/**
+	 * @brief start the task from the beginning, restart if it's running
+	 * @return false if all N slots are taken
+	 */
+	bool spawn(Task &t) {
+		Task **slot = nullptr;
+		for (Task *&p: tasks) {
+			if (p == &t) {
+				slot = &p;
+				break;
+			}
+			if (!p && !slot)
+				slot = &p;
+		}
+		if (!slot)
+			return false;
+		*slot = &t;
+		t.resume = 0;
+		t.state = Task::READY;
+		return true;
+	}
+	/** @brief stop the task wherever it is */
+	void kill(Task &t) {
+		for (Task *&p: tasks)
+			if (p == &t)
+				p = nullptr;
+		t.finish();
+	}
+	/**
+	 * @brief run one slice of every task that is ready by now
+	 *
+	 * The WAITING ones check their condition, that doesn't count as running
+	 * unless it holds, so the caller may sleep till the next interrupt
+	 * @param now - current tick
+	 * @return true if any task ran
+	 */
+	bool run(uint32_t now) {
+		bool ran = false;
+		for (Task *&p: tasks) {
+			Task *t = p;
+			if (!t)
+				continue;
+			if (t->state == Task::SLEEPING && int32_t(now - t->wakeAt) >= 0)
+				t->state = Task::READY;
+			if (t->state != Task::READY && t->state != Task::WAITING)
+				continue;
+			t->now = now;
+			uint32_t start = cycles();
+			t->run();
+			uint32_t spent = cycles() - start;
+			t->stats.slices++;
+			t->stats.cycles += spent;
+			if (spent > t->stats.maxCycles)
+				t->stats.maxCycles = spent;
+			// done, unless it killed and spawned itself again
+			if (t->state == Task::DONE && p == t)
+				p = nullptr;
+			if (t->state != Task::WAITING)
+				ran = true;
+		}
+		return ran;
+	}
+	/** @brief no task at all */
+	bool empty() const {
+		for (Task *p: tasks)
+			if (p)
+				return false;
+		return true;
+	}
+	/**
+	 * @brief the earliest tick a sleeping task wakes up at
+	 * @param[in,out] next - lowered to it if it's earlier
+	 */
+	void nextWake(uint32_t &next) const {
+		for (Task *p: tasks)
+			if (p && p->state == Task::SLEEPING && int32_t(p->wakeAt - next) < 0)
+				next = p->wakeAt;
+	}
+protected:
+	Task *tasks[N];		///< spawned tasks, nullptr for a free slot
+};
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * @file
+ * @brief Tile map layer for character-cell games
+ *
+ * The screen is split into a grid of TW x 8 pixel cells each showing one
+ * tile from a tileset in flash. Only the cells whose tile has changed since
+ * the last draw() get copied into the screen buffer
+ * @author Denis Kokarev
+ */
+#ifndef _TILEMAP_H
+#define _TILEMAP_H
+
+#include <cstdint>
+#include <cstring>
+#include "AF_PCD8544_HAL.h"
+
+/**
+ * @brief Grid of tile indices rendered into AF_PCD8544_HAL buffer
+ *
+ * Typical use is to keep a TileMap in your Window, set() tiles in handleEvent()
+ * and call draw() followed by display.display() from Window::draw()
+ * @tparam TW - tile width, 6 or 8 pixels make good tiles
+ */
+template<int TW>
+class TileMap {
+public:
+	static constexpr int TILE_WIDTH = TW;				///< tile width in pixels
+	static constexpr int TILE_HEIGHT = 8;				///< tile height is one screen bank
+	static constexpr int COLS = LCDWIDTH/TILE_WIDTH;	///< number of tile columns
+	static constexpr int ROWS = LCDHEIGHT/TILE_HEIGHT;	///< number of tile rows
+	/**
+	 * @brief a tile is TW column bytes, LSB on top
+	 */
+	typedef uint8_t Tile[TW];
+	/**
+	 * @brief attach the map to the tileset
+	 * @param _tiles - tileset, should be const to stay in flash
+	 * @param _x - the map's left margin on the screen
+	 */
+	TileMap(const Tile *_tiles, int16_t _x = (LCDWIDTH % TW)/2):tiles(_tiles),x(_x) {
+		fill(0);
+	}
+	/**
+	 * @brief put tile t into the cell
+	 */
+	void set(int c, int r, uint8_t t) {
+		map[r][c] = t;
+	}
+	/**
+	 * @brief which tile is in the cell
+	 */
+	uint8_t get(int c, int r) const {
+		return map[r][c];
+	}
+	/**
+	 * @brief put the same tile into all cells
+	 */
+	void fill(uint8_t t) {
+		memset(map, t, sizeof(map));
+		invalidate();
+	}
+	/**
+	 * @brief have all cells redrawn by the next draw()
+	 *
+	 * Necessary when somebody else painted over the map, e.g. clearDisplay()
+	 */
+	void invalidate() {
+		stale = true;
+	}
+	/**
+	 * @brief copy changed tiles into the screen buffer
+	 * @return number of tiles drawn
+	 */
+	int draw(AF_PCD8544_HAL &display) {
+		int n = 0;
+		for (int r=0; r<ROWS; r++) {
+			for (int c=0; c<COLS; c++) {
+				uint8_t t = map[r][c];
+				if (stale || shown[r][c] != t) {
+					display.drawBank(x + c*TW, r, tiles[t], TW);
+					shown[r][c] = t;
+					n++;
+				}
+			}
+		}
+		stale = false;
+		return n;
+	}
+protected:
+	const Tile *tiles;			///< tileset
+	int16_t x;					///< left margin
+	bool stale;					///< all cells must be redrawn
+	uint8_t map[ROWS][COLS];	///< what tiles we want to see
+	uint8_t shown[ROWS][COLS];	///< what tiles are in the screen buffer
+};
+
+#endif
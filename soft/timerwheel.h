@@ -0,0 +1,268 @@
+/**
+ * @file
+ * @brief Hierarchical timer wheel
+ *
+ * Timers are linked into slots by their expiry tick: level 0 slots are
+ * 1 tick wide, every next level slot spans a whole rotation of the level
+ * below. When the time enters a higher level slot its timers cascade down,
+ * so insert and cancel are O(1) and a tick touches one slot only.
+ * Occupied slot bitmaps let advance() jump over the empty stretches
+ * and tell the next expiry for tickless sleep
+ * @author Denis Kokarev
+ */
+#ifndef _TIMERWHEEL_H
+#define _TIMERWHEEL_H
+
+#include <cstdint>
+
+/**
+ * @brief timer linked into TimerWheel, embed it into your own timer type
+ */
+struct WheelTimer {
+	WheelTimer *next;	///< next in the slot
+	WheelTimer **pprev;	///< what points to us, nullptr if not started
+	uint32_t expires;	///< tick it expires at
+	uint32_t period;	///< ticks to restart it after expiry, 0 - one-shot
+	/** @brief not started */
+	WheelTimer():next(nullptr),pprev(nullptr),expires(0),period(0) {
+	}
+	/** @brief started and not expired yet */
+	bool active() const {
+		return pprev != nullptr;
+	}
+};
+
+/**
+ * @brief the wheel of LEVELS levels with 2^BITS slots each
+ *
+ * Pure logic with no hardware dependencies, the caller feeds it the time.
+ * The span is 2^(BITS*LEVELS) ticks, farther timers wait in the top level
+ * and cascade again
+ * @tparam BITS - log2 of slots per level, up to 5
+ * @tparam LEVELS - number of levels
+ */
+template<int BITS = 4, int LEVELS = 4>
+class TimerWheel {
+	static_assert(BITS > 0 && BITS <= 5 && BITS*LEVELS < 32, "TimerWheel must fit 32 bit slot bitmaps and ticks");
+public:
+	static constexpr int SLOTS = 1 << BITS;			///< slots per level
+	static constexpr uint32_t MASK = SLOTS - 1;		///< slot index mask
+	static constexpr uint32_t SPAN = uint32_t(1) << (BITS*LEVELS);	///< the farthest exact expiry
+	/**
+	 * @param now - current tick
+	 */
+	explicit TimerWheel(uint32_t now = 0):current(now),count(0),occupied(),slots() {
+	}
+	/**
+	 * @brief start or restart the timer
+	 * @param t - the timer, stays linked until it expires or is cancelled
+	 * @param now - current tick, not behind the last advance()
+	 * @param delay - ticks from now, 0 expires on the next advance()
+	 * @param period - ticks between the expiries afterwards, 0 - one-shot
+	 */
+	void start(WheelTimer &t, uint32_t now, uint32_t delay, uint32_t period = 0) {
+		cancel(t);
+		t.expires = now + delay;
+		t.period = period;
+		if (int32_t(t.expires - current) < 0)
+			t.expires = current;
+		link(t);
+	}
+	/**
+	 * @brief stop the timer if it's running
+	 */
+	void cancel(WheelTimer &t) {
+		if (!t.active())
+			return;
+		*t.pprev = t.next;
+		if (t.next)
+			t.next->pprev = t.pprev;
+		// was it the only one in the slot
+		uint32_t l, s;
+		if (!*t.pprev && headOf(t.pprev, l, s))
+			occupied[l] &= ~(uint32_t(1) << s);
+		t.next = nullptr;
+		t.pprev = nullptr;
+		count--;
+	}
+	/**
+	 * @brief no timers running
+	 */
+	bool empty() const {
+		return count == 0;
+	}
+	/**
+	 * @brief the earliest tick advance() may have something to do
+	 *
+	 * Exact for the timers due within a level 0 rotation, the farther
+	 * ones give the tick they cascade down at. Valid unless empty()
+	 */
+	uint32_t nextExpiry() const {
+		uint32_t next = current + SPAN;
+		for (int l=0; l<LEVELS; l++) {
+			if (!occupied[l])
+				continue;
+			uint32_t shift = l*BITS;
+			uint32_t i = (current >> shift) & MASK;
+			uint32_t t;
+			if (l == 0) {
+				t = current + firstFrom(occupied[0], i);
+			} else if (current & ((uint32_t(1) << shift) - 1)) {
+				// the current slot of a higher level has cascaded already
+				uint32_t d = firstFrom(occupied[l], (i + 1) & MASK) + 1;
+				t = ((current >> shift) + d) << shift;
+			} else {
+				// unless advance() stopped right on its boundary
+				t = ((current >> shift) + firstFrom(occupied[l], i)) << shift;
+			}
+			if (int32_t(t - next) < 0)
+				next = t;
+		}
+		return next;
+	}
+	/**
+	 * @brief expire the timers due up to now
+	 *
+	 * The periodic ones are restarted before expire() sees them,
+	 * expire() may start and cancel timers
+	 * @param now - current tick
+	 * @param expire - invoked as expire(WheelTimer &t) in expiry order
+	 */
+	template<typename F>
+	void advance(uint32_t now, F expire) {
+		while (int32_t(now - current) >= 0) {
+			if (count == 0) {
+				current = now + 1;
+				return;
+			}
+			// entering the next slot of the higher levels
+			for (int l=LEVELS-1; l>0; l--)
+				if ((current & ((uint32_t(1) << (l*BITS)) - 1)) == 0)
+					cascade(l, (current >> (l*BITS)) & MASK);
+			uint32_t i = current & MASK;
+			current++;
+			if (occupied[0] & (uint32_t(1) << i))
+				runSlot(i, expire);
+			// to the next occupied slot, stopping at the rotation end to cascade
+			i = current & MASK;
+			if (i == 0)
+				continue;
+			uint32_t step = SLOTS - i;
+			uint32_t rest = occupied[0] >> i;
+			if (rest) {
+				uint32_t d = 0;
+				while (!(rest & 1)) {
+					rest >>= 1;
+					d++;
+				}
+				if (d < step)
+					step = d;
+			}
+			if (int32_t(now - current) < 0)
+				return;
+			if (step > now - current + 1)
+				step = now - current + 1;
+			current += step;
+		}
+	}
+	/**
+	 * @brief the tick advance() is about to process, one past the expiring one inside expire()
+	 */
+	uint32_t time() const {
+		return current;
+	}
+protected:
+	uint32_t current;					///< next tick to process
+	uint32_t count;						///< timers linked
+	uint32_t occupied[LEVELS];			///< bitmaps of non-empty slots
+	WheelTimer *slots[LEVELS][SLOTS];	///< slot lists, a pointer each to save RAM
+	/**
+	 * @brief distance from bit i to the first set bit, wrapping around
+	 */
+	static uint32_t firstFrom(uint32_t bits, uint32_t i) {
+		for (uint32_t d=0; d<SLOTS; d++)
+			if (bits & (uint32_t(1) << ((i + d) & MASK)))
+				return d;
+		return SLOTS;
+	}
+	/**
+	 * @brief is p one of the slot heads, and which one
+	 */
+	bool headOf(WheelTimer *const *p, uint32_t &l, uint32_t &s) const {
+		if (p < &slots[0][0] || p > &slots[LEVELS-1][SLOTS-1])
+			return false;
+		uint32_t n = p - &slots[0][0];
+		l = n / SLOTS;
+		s = n % SLOTS;
+		return true;
+	}
+	/**
+	 * @brief put the timer into the slot its expiry falls in
+	 */
+	void link(WheelTimer &t) {
+		uint32_t diff = t.expires - current;
+		int l = 0;
+		while (l < LEVELS-1 && diff >= (uint32_t(1) << ((l+1)*BITS)))
+			l++;
+		// beyond the span wait in the farthest top level slot
+		uint32_t at = (diff < SPAN) ? t.expires : current + SPAN - 1;
+		uint32_t s = (at >> (l*BITS)) & MASK;
+		WheelTimer *&head = slots[l][s];
+		t.next = head;
+		t.pprev = &head;
+		if (head)
+			head->pprev = &t.next;
+		head = &t;
+		occupied[l] |= uint32_t(1) << s;
+		count++;
+	}
+	/**
+	 * @brief detach the whole slot list
+	 * @return its first timer
+	 */
+	WheelTimer *take(int l, uint32_t s) {
+		WheelTimer *first = slots[l][s];
+		slots[l][s] = nullptr;
+		occupied[l] &= ~(uint32_t(1) << s);
+		return first;
+	}
+	/**
+	 * @brief spread the higher level slot over the lower levels
+	 */
+	void cascade(int l, uint32_t s) {
+		for (WheelTimer *t = take(l, s); t;) {
+			WheelTimer *next = t->next;
+			count--;
+			link(*t);
+			t = next;
+		}
+	}
+	/**
+	 * @brief expire the level 0 slot
+	 *
+	 * The slot is moved to a local list first, so expire() may cancel
+	 * the timers still waiting in it and start new ones for this tick
+	 */
+	template<typename F>
+	void runSlot(uint32_t s, F &expire) {
+		WheelTimer *pending = take(0, s);
+		if (pending)
+			pending->pprev = &pending;
+		while (pending) {
+			WheelTimer *t = pending;
+			pending = t->next;
+			if (pending)
+				pending->pprev = &pending;
+			t->next = nullptr;
+			t->pprev = nullptr;
+			count--;
+			if (t->period) {
+				t->expires += t->period;
+				link(*t);
+			}
+			expire(*t);
+		}
+	}
+};
+
+#endif
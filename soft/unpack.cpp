@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @brief Streaming decoder of packed 1bpp images
+ * @author Denis Kokarev
+ */
+
+#include <cstring>
+#include "unpack.h"
+
+/**
+ * @brief walks the image column by column, bank after bank
+ */
+struct Cursor {
+	uint8_t *bank;		///< current bank start
+	uint8_t col;		///< current column
+	uint8_t w;			///< image width
+	uint16_t stride;	///< distance between the banks
+
+	/// image byte number i
+	Cursor(uint8_t *dst, uint16_t i, uint8_t _w, uint16_t _stride):
+		bank(dst + (i/_w)*_stride), col(i%_w), w(_w), stride(_stride) {
+	}
+	/// columns left in the current bank
+	uint8_t room() const {
+		return w - col;
+	}
+	/// where the next byte goes
+	uint8_t *at() const {
+		return bank + col;
+	}
+	/// skip n bytes within the current bank
+	void advance(uint8_t n) {
+		col += n;
+		if (col == w) {
+			col = 0;
+			bank += stride;
+		}
+	}
+};
+
+uint16_t unpack(const uint8_t *src, uint8_t *dst, uint16_t stride) {
+	const uint8_t *p = src;
+	uint8_t w = *p++;
+	uint8_t banks = *p++;
+	uint16_t size = w*banks;
+	Cursor d(dst, 0, w, stride);
+	for (uint16_t out=0; out<size;) {
+		uint8_t token = *p++;
+		uint16_t n = (token & 0x3f) + PACK_MIN_MATCH;
+		if ((token & PACK_COPY) == PACK_COPY) {
+			// byte by byte, the source may overlap what we write
+			Cursor s(dst, out - (*p++ + 1), w, stride);
+			for (uint16_t i=0; i<n; i++) {
+				*d.at() = *s.at();
+				d.advance(1);
+				s.advance(1);
+			}
+		} else if (token & PACK_RUN) {
+			uint8_t b = *p++;
+			for (uint16_t left=n; left>0;) {
+				uint8_t k = (left < d.room()) ? left : d.room();
+				memset(d.at(), b, k);
+				d.advance(k);
+				left -= k;
+			}
+		} else {
+			n = token + 1;
+			for (uint16_t left=n; left>0;) {
+				uint8_t k = (left < d.room()) ? left : d.room();
+				memcpy(d.at(), p, k);
+				p += k;
+				d.advance(k);
+				left -= k;
+			}
+		}
+		out += n;
+	}
+	return p - src;
+}
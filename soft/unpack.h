@@ -0,0 +1,61 @@
+/**
+ * @file
+ * @brief Streaming decoder of packed 1bpp images
+ *
+ * Images are packed on a PC by vgame-pack tool in PCD8544 bank layout:
+ * column bytes, LSB on top, bank after bank. The stream starts with
+ * 2 bytes of width in columns and height in banks followed by tokens:
+ * - 0nnnnnnn + n+1 bytes - literal bytes
+ * - 10nnnnnn + b - byte b repeated n+3 times
+ * - 11nnnnnn + o - copy n+3 bytes from o+1 bytes back in the image
+ *
+ * Blank areas pack as runs and repeated patterns, such as grids and
+ * font glyphs, as copies
+ * @author Denis Kokarev
+ */
+#ifndef _UNPACK_H
+#define _UNPACK_H
+
+#include <cstdint>
+
+/// literal token
+constexpr uint8_t PACK_LITERAL = 0x00;
+/// run token
+constexpr uint8_t PACK_RUN = 0x80;
+/// copy token
+constexpr uint8_t PACK_COPY = 0xc0;
+/// the longest literal
+constexpr int PACK_MAX_LITERAL = 128;
+/// the shortest run or copy worth a token
+constexpr int PACK_MIN_MATCH = 3;
+/// the longest run or copy
+constexpr int PACK_MAX_MATCH = 64 + PACK_MIN_MATCH - 1;
+/// the farthest copy source
+constexpr int PACK_WINDOW = 256;
+
+/**
+ * @brief width in columns of the packed image
+ */
+inline uint8_t packedWidth(const uint8_t *src) {
+	return src[0];
+}
+
+/**
+ * @brief height in banks of the packed image
+ */
+inline uint8_t packedBanks(const uint8_t *src) {
+	return src[1];
+}
+
+/**
+ * @brief expand the packed image right into its place
+ *
+ * No intermediate buffer, copies refer to the bytes already written to dst
+ * @param src - packed image
+ * @param dst - where the top left column byte goes
+ * @param stride - distance between the banks in dst
+ * @return number of packed bytes consumed
+ */
+uint16_t unpack(const uint8_t *src, uint8_t *dst, uint16_t stride);
+
+#endif
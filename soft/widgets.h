@@ -0,0 +1,98 @@
+/**
+ * @file
+ * @brief Widgets with the geometry known at compile time
+ *
+ * Labels and buttons of constant strings in the classic 6x8 font.
+ * Their boxes are computed by constexpr constructors, so the widgets
+ * themselves may be constexpr objects in flash with nothing to measure
+ * at startup. Drawing goes via the fast text and fill paths of AF_PCD8544_HAL
+ * @author Denis Kokarev
+ */
+#ifndef _WIDGETS_H
+#define _WIDGETS_H
+
+#include <cstdint>
+#include "AF_PCD8544_HAL.h"
+
+/// the classic font cell width with spacing
+constexpr int16_t FONT_WIDTH = 6;
+/// the classic font cell height
+constexpr int16_t FONT_HEIGHT = 8;
+
+/**
+ * @brief string length usable in constant expressions
+ */
+constexpr int16_t textLength(const char *s) {
+	return *s ? 1 + textLength(s+1) : 0;
+}
+
+/**
+ * @brief width of the text in pixels, same as getTextBounds() gives
+ */
+constexpr int16_t textWidth(const char *s, uint8_t size = 1) {
+	return textLength(s) * FONT_WIDTH * size;
+}
+
+/**
+ * @brief a line of text centered around the point
+ */
+struct Label {
+	const char *text;	///< what to print
+	int16_t x;			///< left
+	int16_t y;			///< top
+	int16_t w;			///< width
+	int16_t h;			///< height
+
+	/**
+	 * @param t - the text, must outlive the label
+	 * @param cx - center column
+	 * @param cy - center row
+	 */
+	constexpr Label(const char *t, int16_t cx, int16_t cy):
+		text(t), x(cx - textWidth(t)/2), y(cy - FONT_HEIGHT/2), w(textWidth(t)), h(FONT_HEIGHT) {
+	}
+	/**
+	 * @brief print the text opaque
+	 */
+	void draw(AF_PCD8544_HAL &d, uint16_t color = BLACK) const {
+		d.setTextSize(1);
+		d.setTextColor(color, !color);
+		d.setCursor(x, y);
+		d.print(text);
+	}
+};
+
+/**
+ * @brief a label in a rounded frame, replaces Adafruit_GFX_Button
+ */
+struct Button {
+	static constexpr int16_t PAD_X = 4;		///< frame to text distance on the sides
+	static constexpr int16_t PAD_Y = 2;		///< frame to text distance on top and bottom
+	Label label;		///< the text inside
+	int16_t x;			///< left
+	int16_t y;			///< top
+	int16_t w;			///< width
+	int16_t h;			///< height
+
+	/**
+	 * @param t - the text, must outlive the button
+	 * @param cx - center column
+	 * @param cy - center row
+	 */
+	constexpr Button(const char *t, int16_t cx, int16_t cy):
+		label(t, cx, cy),
+		x(cx - textWidth(t)/2 - PAD_X), y(cy - FONT_HEIGHT/2 - PAD_Y),
+		w(textWidth(t) + 2*PAD_X), h(FONT_HEIGHT + 2*PAD_Y) {
+	}
+	/**
+	 * @brief paint the button, the pressed one is inverted
+	 */
+	void draw(AF_PCD8544_HAL &d, bool pressed = false) const {
+		uint16_t bg = pressed ? BLACK : WHITE;
+		d.fillRect(x+1, y+1, w-2, h-2, bg);
+		d.drawRoundRect(x, y, w, h, (w < h ? w : h)/4, BLACK);
+		label.draw(d, !bg);
+	}
+};
+
+#endif
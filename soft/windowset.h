@@ -0,0 +1,173 @@
+/**
+ * @file
+ * @brief Closed set of windows sharing one storage, dispatched without vtables
+ *
+ * Only one window of a program is active at a time, so WindowSet keeps
+ * them in a tagged union: the largest one sets its size, and the tag picks
+ * the handleEvent() and draw() to call. The window types are known at
+ * compile time, the calls inline into a switch over the tag
+ * @author Denis Kokarev
+ */
+#ifndef _WINDOWSET_H
+#define _WINDOWSET_H
+
+#include <cstdint>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+/**
+ * @brief optional base of the WindowSet windows, all the calls are resolved statically
+ *
+ * A window must have handleEvent() and draw(), the same as Window but not virtual.
+ * It's default-constructed when shown and destroyed when another one is shown
+ */
+struct StaticWindow {
+	/** @brief no static part by default, @see Window::drawStatic() */
+	bool drawStatic() {
+		return false;
+	}
+};
+
+/**
+ * @brief per window type steps of WindowSet dispatch, I is the tag of W
+ */
+template<int I, typename... Ws>
+struct WindowOps {
+	static constexpr std::size_t size = 1;
+	static constexpr std::size_t align = 1;
+	template<typename E>
+	static E handleEvent(uint8_t, void *, E) {
+		return E();
+	}
+	static void draw(uint8_t, void *) {
+	}
+	static bool drawStatic(uint8_t, void *) {
+		return false;
+	}
+	static void construct(uint8_t, void *) {
+	}
+	static void destroy(uint8_t, void *) {
+	}
+};
+
+template<int I, typename W, typename... Rest>
+struct WindowOps<I, W, Rest...> {
+	typedef WindowOps<I+1, Rest...> Next;
+	static constexpr std::size_t size = sizeof(W) > Next::size ? sizeof(W) : Next::size;			///< of the largest window
+	static constexpr std::size_t align = alignof(W) > Next::align ? alignof(W) : Next::align;	///< the strictest alignment
+	template<typename E>
+	static E handleEvent(uint8_t tag, void *p, E e) {
+		return (tag == I) ? static_cast<W*>(p)->handleEvent(e) : Next::handleEvent(tag, p, e);
+	}
+	static void draw(uint8_t tag, void *p) {
+		if (tag == I)
+			static_cast<W*>(p)->draw();
+		else
+			Next::draw(tag, p);
+	}
+	static bool drawStatic(uint8_t tag, void *p) {
+		return (tag == I) ? static_cast<W*>(p)->drawStatic() : Next::drawStatic(tag, p);
+	}
+	static void construct(uint8_t tag, void *p) {
+		if (tag == I)
+			new(p) W();
+		else
+			Next::construct(tag, p);
+	}
+	static void destroy(uint8_t tag, void *p) {
+		if (tag == I)
+			static_cast<W*>(p)->~W();
+		else
+			Next::destroy(tag, p);
+	}
+};
+
+/**
+ * @brief tag of X among Ws
+ */
+template<typename X, typename... Ws>
+struct WindowTag;
+
+template<typename X, typename... Rest>
+struct WindowTag<X, X, Rest...> {
+	static constexpr uint8_t value = 0;
+};
+
+template<typename X, typename W, typename... Rest>
+struct WindowTag<X, W, Rest...> {
+	static constexpr uint8_t value = 1 + WindowTag<X, Rest...>::value;
+};
+
+/**
+ * @brief one of the windows Ws at a time
+ *
+ * show() replaces the active window. Asked from the active window's
+ * handleEvent(), it takes effect once that returns, @see commit()
+ */
+template<typename... Ws>
+class WindowSet {
+	static_assert(sizeof...(Ws) > 0 && sizeof...(Ws) < 255, "WindowSet needs 1 to 254 windows");
+	typedef WindowOps<0, Ws...> Ops;
+public:
+	static constexpr uint8_t NONE = 0xff;	///< no window tag
+	WindowSet():active(NONE),next(NONE),dispatching(false) {
+	}
+	~WindowSet() {
+		Ops::destroy(active, &storage);
+	}
+	/**
+	 * @brief make W the active window
+	 * @return true if it's active now, false if pending till commit()
+	 */
+	template<typename W>
+	bool show() {
+		next = WindowTag<W, Ws...>::value;
+		return !dispatching && commit();
+	}
+	/**
+	 * @brief replace the active window with the one show() asked for
+	 * @return true if replaced, so it needs painting
+	 */
+	bool commit() {
+		if (next == active)
+			return false;
+		Ops::destroy(active, &storage);
+		active = next;
+		Ops::construct(active, &storage);
+		return true;
+	}
+	/** @brief is W the active window */
+	template<typename W>
+	bool is() const {
+		return active == WindowTag<W, Ws...>::value;
+	}
+	/** @brief the active window, which must be W */
+	template<typename W>
+	W &get() {
+		return *reinterpret_cast<W*>(&storage);
+	}
+	/** @brief handleEvent() of the active window, E() if there is none */
+	template<typename E>
+	E handleEvent(E e) {
+		dispatching = true;
+		E r = Ops::handleEvent(active, &storage, e);
+		dispatching = false;
+		return r;
+	}
+	/** @brief draw() of the active window */
+	void draw() {
+		Ops::draw(active, &storage);
+	}
+	/** @brief drawStatic() of the active window */
+	bool drawStatic() {
+		return Ops::drawStatic(active, &storage);
+	}
+protected:
+	typename std::aligned_storage<Ops::size, Ops::align>::type storage;	///< the active window
+	uint8_t active;		///< its tag
+	uint8_t next;		///< the tag show() asked for
+	bool dispatching;	///< inside handleEvent()
+};
+
+#endif